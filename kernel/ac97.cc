@@ -0,0 +1,417 @@
+#include "ac97.h"
+#include "pci.h"
+#include "debug.h"
+#include "machine.h"
+#include "idt.h"
+#include "ioapic.h"
+#include "smp.h"
+#include "physmem.h"
+#include "semaphore.h"
+
+// Some of the code is from ChatGPT, some is adapted from OSDev.
+
+#define AC97_VENDOR_ID 0x8086 // Example: Intel's vendor ID
+#define AC97_DEVICE_ID 0x2415 // Example: AC97's device ID
+
+/* Where we want the AC97 to interrupt us */
+constexpr uint32_t AC97_vector = 41;
+bool setupBuffers = false;
+
+namespace AC97
+{
+    constexpr uint16_t AC97_RESET_REG = 0x00;
+    constexpr uint16_t AC97_MASTER_VOL_REG = 0x02;
+    constexpr uint16_t AC97_AUX_VOL_REG = 0x04;
+    constexpr uint16_t AC97_PCM_OUT_VOL_REG = 0x18;
+    constexpr uint16_t AC97_EXTENDED_AUDIO_REG = 0x28;
+    constexpr uint16_t AC97_EXTENDED_STATUS_REG = 0x2A;
+    constexpr uint16_t AC97_PCM_DAC_RATE_REG = 0x2C;
+    constexpr uint16_t AC97_PCM_SURR_RATE_REG = 0x2E;
+    constexpr uint16_t AC97_PCM_LFE_RATE_REG = 0x30;
+    constexpr uint16_t AC97_PCM_ADC_RATE_REG = 0x32;
+    constexpr uint16_t AC97_NABM_IO_GLOBAL_CONTROL = 0x2C;
+    constexpr uint16_t AC97_RECORD_SELECT_REG = 0x1A;
+    constexpr uint16_t AC97_RECORD_GAIN_REG = 0x1C;
+
+    constexpr uint16_t RECORD_LINE_IN = 0x0404; // same source for both channels
+
+    // Bus master box registers (relative to BAR1 for PCM out, BAR_IN for PCM in)
+    constexpr uint16_t BDBAR = 0x00; // buffer descriptor list base address
+    constexpr uint16_t CIV = 0x04;   // current index value
+    constexpr uint16_t LVI = 0x05;   // last valid index
+    constexpr uint16_t SR = 0x06;    // status
+    constexpr uint16_t PICB = 0x08;  // samples left in the current buffer
+    constexpr uint16_t CR = 0x0B;    // control
+
+    constexpr uint8_t SR_DCH = 1 << 0;  // DMA controller halted
+    constexpr uint8_t SR_LVBCI = 1 << 2;
+    constexpr uint8_t SR_BCIS = 1 << 3;
+    constexpr uint8_t SR_FIFOE = 1 << 4;
+
+    constexpr uint8_t CR_RPBM = 1 << 0; // run/pause bus master
+    constexpr uint8_t CR_RR = 1 << 1;   // reset registers
+    constexpr uint8_t CR_LVBIE = 1 << 2; // interrupt when the last valid buffer completes
+    constexpr uint8_t CR_IOCE = 1 << 4;  // interrupt on descriptors with BD_IOC set
+
+    constexpr uint16_t EA_VRA = 1 << 0; // variable rate audio (extended ID and status/control)
+
+    uint32_t BAR0;
+    uint32_t BAR1;
+    uint32_t BAR_IN;
+    uint32_t GCR;
+    uint32_t IRQ;
+    bool variableRate = false;
+    BufferDescriptor *audio_buffers;
+    BufferDescriptor *capture_buffers;
+
+    // upped by the interrupt handler every time a buffer completes
+    static Semaphore *completions = nullptr;
+    // only a wakeup, waitForCapture() reads CIV for what actually filled
+    static Semaphore *captures = nullptr;
+
+    bool audioPlaying = false;
+    volatile uint32_t completedAt = 0;
+    volatile uint32_t lastValidEvents = 0;
+    volatile uint32_t fifoErrors = 0;
+    void setupDMABuffers(uint32_t nabm_base)
+    {
+        if (setupBuffers)
+        {
+            return;
+        }
+        // The controller wants the list 8 byte aligned; all the sample
+        // buffers come out of one contiguous region
+        auto list = DMA::alloc(NUM_BUFFERS * sizeof(BufferDescriptor), 8);
+        auto samples = DMA::alloc(NUM_BUFFERS * BUFFER_SAMPLES * sizeof(int16_t), PhysMem::FRAME_SIZE);
+        if (list.isNull() || samples.isNull())
+        {
+            Debug::panic("AC97: out of DMA memory");
+        }
+        audio_buffers = list.virt<BufferDescriptor>();
+        for (uint32_t i = 0; i < NUM_BUFFERS; i++)
+        {
+            audio_buffers[i].pointer = samples.phys() + i * BUFFER_SAMPLES * sizeof(int16_t);
+            audio_buffers[i].length = BUFFER_SAMPLES;
+            audio_buffers[i].control = BD_IOC;
+        }
+
+        list = DMA::alloc(CAPTURE_BUFFERS * sizeof(BufferDescriptor), 8);
+        samples = DMA::alloc(CAPTURE_BUFFERS * CAPTURE_SAMPLES * sizeof(int16_t), PhysMem::FRAME_SIZE);
+        if (list.isNull() || samples.isNull())
+        {
+            Debug::panic("AC97: out of DMA memory");
+        }
+        capture_buffers = list.virt<BufferDescriptor>();
+        for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++)
+        {
+            capture_buffers[i].pointer = samples.phys() + i * CAPTURE_SAMPLES * sizeof(int16_t);
+            capture_buffers[i].length = CAPTURE_SAMPLES;
+            capture_buffers[i].control = BD_IOC;
+        }
+
+        // Assuming the first descriptor is located at nabm_base + 0x00 for PCM Out
+        // Debug::printf("| DMA buffers setup completed.\n");
+        setupBuffers = true;
+    }
+    // Initialize AC97 codec and set up basic operation
+    void initializeCodec()
+    {
+        // Properly setting global control register, ensuring correct register (0x6C)
+
+        outl(GCR, (0b00 << 22) | (0b00 << 20) | (0 << 2) | (1 << 1));
+
+        outb(BAR1 + CR, CR_RR);
+
+        // Reset the codec by writing to the reset register using outl for 32-bit value simulation
+        outw(BAR0, 0xFF);
+
+        // Set volume levels to maximum (0x0000 is maximum, 0x8000 is mute in AC97)
+        // int temp = nam_base + AC97_MASTER_VOL_REG;
+
+        outw(BAR0 + AC97_PCM_OUT_VOL_REG, 0x0); // PCM volume to max
+
+        // Without VRA the DACs are locked to 48kHz and the mixer has to resample
+        if (inw(BAR0 + AC97_EXTENDED_AUDIO_REG) & EA_VRA)
+        {
+            outw(BAR0 + AC97_EXTENDED_STATUS_REG, inw(BAR0 + AC97_EXTENDED_STATUS_REG) | EA_VRA);
+            variableRate = (inw(BAR0 + AC97_EXTENDED_STATUS_REG) & EA_VRA) != 0;
+        }
+        Debug::printf("| AC97 variable rate audio %s\n", variableRate ? "on" : "off");
+
+        setupDMABuffers(BAR1);
+
+        completions = new Semaphore(0);
+        captures = new Semaphore(0);
+        IDT::interrupt(AC97_vector, (uint32_t)ac97Handler_);
+        IOAPIC::route(IRQ, AC97_vector, SMP::me(), true);
+
+        outl(BAR0 + AC97_MASTER_VOL_REG, 0x0000); // Master volume to max
+        // outl(BAR0 + AC97_AUX_VOL_REG, 0x0000);    // AUX volume to max
+
+        // Enable audio output
+
+        Debug::printf("| AC97 codec initialized with NAM base I/O address 0x%X and NABM base I/O address 0x%X\n", BAR0, BAR1);
+    }
+
+    static bool found = false;
+
+    void init(uint32_t nam, uint32_t nabm, uint32_t irq)
+    {
+        BAR0 = nam;
+        BAR_IN = nabm + 0x00;
+        BAR1 = nabm + 0x10;
+        GCR = nabm + 0x2C;
+        IRQ = irq;
+        initializeCodec();
+        found = true;
+    }
+
+    bool present()
+    {
+        return found;
+    }
+
+    static bool probe(const PCI::Device &d)
+    {
+        if (found)
+        {
+            return false;
+        }
+        Debug::printf("| Found AC97.\n");
+        PCI::enable(d, PCI::COMMAND_IO | PCI::COMMAND_BUS_MASTER);
+        init(d.ioBase(0), d.ioBase(1), d.irq);
+        return true;
+    }
+
+    void registerDriver()
+    {
+        PCI::registerDriver(PCI::Driver{"AC97", AC97_VENDOR_ID, AC97_DEVICE_ID, PCI::ANY, probe});
+    }
+
+    uint32_t setSampleRate(uint32_t sample_rate)
+    {
+        if (!variableRate)
+        {
+            return FIXED_RATE;
+        }
+        if (sample_rate > FIXED_RATE)
+        {
+            sample_rate = FIXED_RATE;
+        }
+        // set same variable rate on all outputs
+        outw(BAR0 + AC97_PCM_DAC_RATE_REG, sample_rate);
+        outw(BAR0 + AC97_PCM_SURR_RATE_REG, sample_rate);
+        outw(BAR0 + AC97_PCM_LFE_RATE_REG, sample_rate);
+
+        // the codec rounds to the rates it supports, believe what it says
+        return inw(BAR0 + AC97_PCM_DAC_RATE_REG);
+    }
+
+    // Reset a bus master box: stops DMA and clears CIV/LVI/status
+    static void resetChannel(uint32_t box)
+    {
+        outb(box + CR, CR_RR);
+        while (inb(box + CR) & CR_RR)
+        {
+            iAmStuckInALoop(false);
+        }
+    }
+
+    static void resetChannel()
+    {
+        resetChannel(BAR1);
+    }
+
+    // Points the PCM out box at the BDL and programs the rate. The
+    // caller fills descriptors and then calls run(). Returns the rate
+    // the codec actually runs at.
+    uint32_t start(uint32_t sampleRate)
+    {
+        resetChannel();
+        uint32_t rate = setSampleRate(sampleRate);
+        outl(BAR1 + BDBAR, DMA::phys(audio_buffers));
+        audioPlaying = true;
+        return rate;
+    }
+
+    void run(uint32_t lastValid)
+    {
+        outb(BAR1 + LVI, lastValid);
+        outb(BAR1 + CR, CR_RPBM | CR_LVBIE | CR_IOCE);
+    }
+
+    uint32_t currentIndex()
+    {
+        return inb(BAR1 + CIV);
+    }
+
+    uint32_t position(uint32_t &civ)
+    {
+        // PICB belongs to whatever CIV was when it was read; if CIV moved
+        // in between, read both again
+        uint32_t picb;
+        do
+        {
+            civ = inb(BAR1 + CIV);
+            picb = inw(BAR1 + PICB);
+        } while ((uint32_t)inb(BAR1 + CIV) != civ);
+        return picb;
+    }
+
+    // Hands descriptor i back to the hardware. If DMA ran dry waiting
+    // for it, writing LVI restarts it.
+    void setLastValid(uint32_t i)
+    {
+        outb(BAR1 + LVI, i);
+    }
+
+    void waitForBuffer()
+    {
+        completions->down();
+    }
+
+    void halt()
+    {
+        outb(BAR1 + CR, 0);
+        resetChannel();
+        audioPlaying = false;
+    }
+
+    bool isPlaying()
+    {
+        return audioPlaying;
+    }
+
+    uint32_t setCaptureRate(uint32_t sampleRate)
+    {
+        if (!variableRate)
+        {
+            return FIXED_RATE;
+        }
+        outw(BAR0 + AC97_PCM_ADC_RATE_REG, sampleRate > FIXED_RATE ? FIXED_RATE : sampleRate);
+        return inw(BAR0 + AC97_PCM_ADC_RATE_REG);
+    }
+
+    uint32_t startCapture(uint32_t sampleRate)
+    {
+        resetChannel(BAR_IN);
+
+        uint32_t rate = setCaptureRate(sampleRate);
+        outw(BAR0 + AC97_RECORD_SELECT_REG, RECORD_LINE_IN);
+        outw(BAR0 + AC97_RECORD_GAIN_REG, 0x0000); // 0dB, unmuted
+
+        outl(BAR_IN + BDBAR, DMA::phys(capture_buffers));
+        outb(BAR_IN + LVI, CAPTURE_BUFFERS - 1);
+        outb(BAR_IN + CR, CR_RPBM | CR_LVBIE | CR_IOCE);
+        return rate;
+    }
+
+    // Descriptors from the reader's index up to CIV are filled. CIV
+    // itself is still being filled, unless the engine halted there at
+    // LVI, in which case it is done too. Interrupts can merge, so they
+    // only say "look again".
+    static bool captured(uint32_t i)
+    {
+        return (uint32_t)inb(BAR_IN + CIV) != i || (inw(BAR_IN + SR) & SR_DCH) != 0;
+    }
+
+    void waitForCapture(uint32_t i)
+    {
+        while (!captured(i))
+        {
+            captures->down();
+        }
+    }
+
+    void releaseCapture(uint32_t i)
+    {
+        outb(BAR_IN + LVI, i);
+    }
+
+    void stopCapture()
+    {
+        outb(BAR_IN + CR, 0);
+        resetChannel(BAR_IN);
+    }
+
+    // The PCM out box for the mixer. DMA stops at LVI, so a late refill
+    // plays nothing rather than old samples, and descriptor lengths can
+    // change from one period to the next.
+    class Output : public AudioBackend
+    {
+    public:
+        const char *name() override { return "AC97"; }
+        uint32_t maxSlots() override { return NUM_BUFFERS; }
+        uint32_t maxFrames() override { return BUFFER_SAMPLES / 2; }
+
+        uint32_t start(uint32_t rate, uint32_t &frames, uint32_t &count) override
+        {
+            if (frames > maxFrames())
+                frames = maxFrames();
+            if (count > NUM_BUFFERS)
+                count = NUM_BUFFERS;
+            return AC97::start(rate);
+        }
+
+        void run(uint32_t lastValid) override { AC97::run(lastValid); }
+        uint32_t slots() override { return NUM_BUFFERS; }
+        int16_t *buffer(uint32_t i) override { return AC97::buffer(i); }
+        uint32_t frames(uint32_t i) override { return audio_buffers[i].length / 2; }
+
+        bool resizable() override { return true; }
+
+        void setFrames(uint32_t i, uint32_t frames) override
+        {
+            audio_buffers[i].length = frames * 2;
+            audio_buffers[i].control = BD_IOC;
+        }
+
+        void setLastValid(uint32_t i) override { AC97::setLastValid(i); }
+        uint32_t position(uint32_t &current) override { return AC97::position(current) / 2; }
+        void waitForBuffer() override { AC97::waitForBuffer(); }
+        void halt() override { AC97::halt(); }
+        uint32_t completedAt() override { return AC97::completedAt; }
+        uint32_t lastValidEvents() override { return AC97::lastValidEvents; }
+        uint32_t fifoErrors() override { return AC97::fifoErrors; }
+    };
+
+    static Output output;
+
+    AudioBackend *backend()
+    {
+        return &output;
+    }
+}
+
+extern "C" void ac97Handler(uint32_t *things)
+{
+    // interrupts are disabled.
+    using namespace AC97;
+    // both boxes share the line
+    uint32_t sr = inw(BAR1 + SR);
+    uint32_t in = inw(BAR_IN + SR);
+    // the line is level triggered, acknowledge before the EOI
+    outw(BAR1 + SR, sr & (SR_LVBCI | SR_BCIS | SR_FIFOE));
+    outw(BAR_IN + SR, in & (SR_LVBCI | SR_BCIS | SR_FIFOE));
+    SMP::eoi_reg.set(0);
+    if (sr & SR_BCIS)
+    {
+        completedAt = (uint32_t)rdtsc();
+    }
+    if (sr & SR_LVBCI)
+    {
+        lastValidEvents++;
+    }
+    if (sr & SR_FIFOE)
+    {
+        fifoErrors++;
+    }
+    if ((sr & (SR_LVBCI | SR_BCIS)) && completions != nullptr)
+    {
+        completions->up();
+    }
+    if ((in & (SR_LVBCI | SR_BCIS)) && captures != nullptr)
+    {
+        captures->up();
+    }
+}
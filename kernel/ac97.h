@@ -0,0 +1,94 @@
+#ifndef _AC97_H_
+#define _AC97_H_
+
+#include <stdint.h>
+#include "machine.h"
+#include "dma.h"
+#include "audiobackend.h"
+
+namespace AC97
+{
+    // Tells PCI to hand us the first Intel 82801AA AC97 it finds
+    extern void registerDriver();
+    // Brings up the codec behind the NAM (mixer) and NABM (bus master) I/O
+    // ranges and takes interrupts on `irq`
+    extern void init(uint32_t nam, uint32_t nabm, uint32_t irq);
+    // false until init() found one; capture only works with an AC97
+    extern bool present();
+    // the PCM out ring for the mixer
+    extern AudioBackend *backend();
+
+    struct BufferDescriptor
+    {
+        uint32_t pointer; // Physical address of the buffer
+        uint16_t length;  // Length of the buffer in samples
+        uint16_t control; // IOC/BUP flags
+    };
+    constexpr uint16_t BD_IOC = 1 << 15; // interrupt when this buffer completes
+    constexpr uint16_t BD_BUP = 1 << 14; // play silence (not the last sample) after the last buffer
+    constexpr uint32_t NUM_BUFFERS = 32;
+    constexpr uint32_t BUFFER_SAMPLES = 4096; // 16-bit samples per descriptor, 2048 stereo frames
+
+    extern uint32_t BAR0;
+    extern uint32_t BAR1;
+    extern uint32_t GCR;
+    extern uint32_t IRQ;
+    extern BufferDescriptor* audio_buffers;
+
+    // where the CPU sees descriptor i's samples
+    inline int16_t* buffer(uint32_t i)
+    {
+        return (int16_t*) DMA::virt(audio_buffers[i].pointer);
+    }
+
+    constexpr uint32_t FIXED_RATE = 48000; // the only rate without VRA
+
+    // PCM in (capture) box, a ring of its own
+    extern uint32_t BAR_IN;
+    extern BufferDescriptor* capture_buffers;
+    constexpr uint32_t CAPTURE_BUFFERS = 32;
+    constexpr uint32_t CAPTURE_SAMPLES = 2048; // 1024 stereo frames
+
+    inline int16_t* captureBuffer(uint32_t i)
+    {
+        return (int16_t*) DMA::virt(capture_buffers[i].pointer);
+    }
+
+    extern bool audioPlaying;
+    extern bool variableRate;
+    // Programs the DAC rate, returns the rate the codec accepted
+    extern uint32_t setSampleRate(uint32_t sample_rate);
+
+    // PCM out DMA ring. The BDL is a ring of NUM_BUFFERS descriptors, the
+    // hardware walks from currentIndex() towards the last valid index and
+    // raises an interrupt as each descriptor completes.
+    extern uint32_t start(uint32_t sampleRate);
+    extern void run(uint32_t lastValid);
+    extern uint32_t currentIndex();
+    // Samples descriptor `civ` still has to play, consistent with `civ`
+    extern uint32_t position(uint32_t &civ);
+    extern void setLastValid(uint32_t i);
+    extern void waitForBuffer();
+    extern void halt();
+    extern bool isPlaying();
+
+    // Kept by the interrupt handler for the PCM out box: low half of the
+    // TSC when a buffer last completed, how often the hardware reached the
+    // last valid buffer (ran out of data), and FIFO errors
+    extern volatile uint32_t completedAt;
+    extern volatile uint32_t lastValidEvents;
+    extern volatile uint32_t fifoErrors;
+
+    // Capture ring. All descriptors start out owned by the hardware; the
+    // reader waits for descriptor i to fill (judged from CIV, not from
+    // counting interrupts) and hands each one back with releaseCapture(). If the reader falls a whole ring behind, capture
+    // pauses until it catches up. Both return the rate the codec took,
+    // which without VRA is always FIXED_RATE.
+    extern uint32_t setCaptureRate(uint32_t sampleRate);
+    extern uint32_t startCapture(uint32_t sampleRate);
+    extern void waitForCapture(uint32_t i);
+    extern void releaseCapture(uint32_t i);
+    extern void stopCapture();
+}
+
+#endif
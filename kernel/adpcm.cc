@@ -0,0 +1,289 @@
+#include "adpcm.h"
+
+static inline int32_t clamp16(int32_t v)
+{
+    if (v > 32767)
+        return 32767;
+    if (v < -32768)
+        return -32768;
+    return v;
+}
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// writes one sample to its place in a stereo frame, mono goes to both sides
+static inline void put(int16_t *frame, uint32_t channel, uint32_t channels, int32_t v)
+{
+    frame[channel] = (int16_t)v;
+    if (channels == 1)
+    {
+        frame[1] = (int16_t)v;
+    }
+}
+
+// IMA / DVI ADPCM
+//
+// Per channel header: initial sample (16 bits), step index (8 bits), pad.
+// The data that follows interleaves channels every 4 bytes (8 samples),
+// low nibble first.
+class ImaDecoder : public AdpcmDecoder
+{
+    static constexpr int8_t indexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+    static constexpr int16_t stepTable[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+        253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+        1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+        3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+        12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+    struct State
+    {
+        int32_t predictor;
+        int32_t index;
+
+        inline int32_t next(uint32_t nibble)
+        {
+            int32_t step = stepTable[index];
+            int32_t diff = step >> 3;
+            if (nibble & 1)
+                diff += step >> 2;
+            if (nibble & 2)
+                diff += step >> 1;
+            if (nibble & 4)
+                diff += step;
+            predictor = clamp16((nibble & 8) ? predictor - diff : predictor + diff);
+            index += indexTable[nibble];
+            if (index < 0)
+                index = 0;
+            if (index > 88)
+                index = 88;
+            return predictor;
+        }
+    };
+
+public:
+    using AdpcmDecoder::AdpcmDecoder;
+
+    uint32_t decode(const uint8_t *block, uint32_t bytes, int16_t *out) override
+    {
+        uint32_t header = 4 * channels;
+        if (bytes < header)
+        {
+            return 0;
+        }
+
+        State state[2];
+        for (uint32_t c = 0; c < channels; c++)
+        {
+            state[c].predictor = (int16_t)le16(block + 4 * c);
+            state[c].index = block[4 * c + 2];
+            if (state[c].index > 88)
+                state[c].index = 88;
+            put(out, c, channels, state[c].predictor);
+        }
+
+        // 8 frames per group of 4 bytes from every channel
+        uint32_t groups = (bytes - header) / header;
+        const uint8_t *in = block + header;
+        int16_t *frames = out + 2;
+        for (uint32_t g = 0; g < groups; g++)
+        {
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                for (uint32_t i = 0; i < 4; i++)
+                {
+                    uint32_t b = *in++;
+                    put(frames + (2 * i) * 2, c, channels, state[c].next(b & 0xF));
+                    put(frames + (2 * i + 1) * 2, c, channels, state[c].next(b >> 4));
+                }
+            }
+            frames += 8 * 2;
+        }
+
+        uint32_t n = 1 + groups * 8;
+        return n < framesPerBlock ? n : framesPerBlock;
+    }
+};
+
+constexpr int8_t ImaDecoder::indexTable[16];
+constexpr int16_t ImaDecoder::stepTable[89];
+
+// Microsoft ADPCM
+//
+// Per channel header (fields interleaved across channels): predictor
+// index, delta, sample 1, sample 2. Sample 2 is the older one and is
+// played first. Data is one nibble per sample, high nibble first,
+// channels interleaved sample by sample.
+class MsDecoder : public AdpcmDecoder
+{
+    static constexpr int32_t adaptationTable[16] = {230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230};
+
+public:
+    constexpr static uint32_t MAX_COEFS = 7;
+    static constexpr int16_t standardCoefs[MAX_COEFS][2] = {{256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232}};
+
+    int16_t coefs[MAX_COEFS][2];
+    uint32_t numCoefs = MAX_COEFS;
+
+    struct State
+    {
+        int32_t c1, c2;
+        int32_t delta;
+        int32_t s1, s2;
+
+        inline int32_t next(uint32_t nibble)
+        {
+            int32_t signedNibble = (int32_t)(nibble ^ 8) - 8;
+            int32_t predictor = clamp16(((s1 * c1 + s2 * c2) >> 8) + signedNibble * delta);
+            s2 = s1;
+            s1 = predictor;
+            delta = (adaptationTable[nibble] * delta) >> 8;
+            if (delta < 16)
+                delta = 16;
+            return predictor;
+        }
+    };
+
+    MsDecoder(uint16_t channels, uint16_t blockBytes, uint16_t framesPerBlock) : AdpcmDecoder(channels, blockBytes, framesPerBlock)
+    {
+        for (uint32_t i = 0; i < MAX_COEFS; i++)
+        {
+            coefs[i][0] = standardCoefs[i][0];
+            coefs[i][1] = standardCoefs[i][1];
+        }
+    }
+
+    uint32_t decode(const uint8_t *block, uint32_t bytes, int16_t *out) override
+    {
+        uint32_t header = 7 * channels;
+        if (bytes < header)
+        {
+            return 0;
+        }
+
+        // the header alone holds two frames, a block shorter than that
+        // doesn't fit what the caller made room for
+        uint32_t n = 2 + (bytes - header) * 2 / channels;
+        if (n > framesPerBlock)
+        {
+            n = framesPerBlock;
+        }
+        if (n < 2)
+        {
+            return 0;
+        }
+
+        State state[2];
+        for (uint32_t c = 0; c < channels; c++)
+        {
+            uint32_t predictor = block[c];
+            if (predictor >= numCoefs)
+                predictor = 0;
+            state[c].c1 = coefs[predictor][0];
+            state[c].c2 = coefs[predictor][1];
+            state[c].delta = (int16_t)le16(block + channels + 2 * c);
+            state[c].s1 = (int16_t)le16(block + 3 * channels + 2 * c);
+            state[c].s2 = (int16_t)le16(block + 5 * channels + 2 * c);
+            put(out, c, channels, state[c].s2);
+            put(out + 2, c, channels, state[c].s1);
+        }
+
+        // samples after the header, alternating channels when stereo
+        const uint8_t *in = block + header;
+        uint32_t samples = (n - 2) * channels;
+        int16_t *frames = out + 4;
+        for (uint32_t i = 0; i < samples; i += 2)
+        {
+            uint32_t b = *in++;
+            if (channels == 2)
+            {
+                frames[0] = (int16_t)state[0].next(b >> 4);
+                frames[1] = (int16_t)state[1].next(b & 0xF);
+                frames += 2;
+            }
+            else
+            {
+                put(frames, 0, 1, state[0].next(b >> 4));
+                frames += 2;
+                if (i + 1 < samples)
+                {
+                    put(frames, 0, 1, state[0].next(b & 0xF));
+                    frames += 2;
+                }
+            }
+        }
+        return n;
+    }
+};
+
+constexpr int32_t MsDecoder::adaptationTable[16];
+constexpr int16_t MsDecoder::standardCoefs[MsDecoder::MAX_COEFS][2];
+
+AdpcmDecoder *AdpcmDecoder::make(uint16_t formatTag, uint16_t channels, uint16_t blockAlign, const uint8_t *ext, uint32_t extBytes)
+{
+    if (channels < 1 || channels > 2)
+    {
+        return nullptr;
+    }
+
+    if (formatTag == WAVE_FORMAT_IMA_ADPCM)
+    {
+        if (blockAlign < 8 * channels)
+        {
+            return nullptr;
+        }
+        // every byte of the block is data, so the block size decides
+        uint32_t fits = 1 + (blockAlign - 4 * channels) / (4 * channels) * 8;
+        if (fits > 0xFFFF)
+        {
+            return nullptr;
+        }
+        return new ImaDecoder(channels, blockAlign, fits);
+    }
+
+    if (formatTag == WAVE_FORMAT_ADPCM)
+    {
+        if (blockAlign <= 7 * channels)
+        {
+            return nullptr;
+        }
+        // samplesPerBlock follows cbSize
+        uint32_t framesPerBlock = (extBytes >= 4) ? le16(ext + 2) : 0;
+        uint32_t fits = 2 + (blockAlign - 7 * channels) * 2 / channels;
+        if (fits > 0xFFFF)
+        {
+            return nullptr;
+        }
+        if (framesPerBlock < 2 || framesPerBlock > fits)
+        {
+            framesPerBlock = fits;
+        }
+        auto decoder = new MsDecoder(channels, blockAlign, framesPerBlock);
+
+        // files may carry their own coefficient table after numCoef
+        if (extBytes >= 6)
+        {
+            uint32_t count = le16(ext + 4);
+            if (count > MsDecoder::MAX_COEFS)
+            {
+                count = MsDecoder::MAX_COEFS;
+            }
+            if (count > 0 && extBytes >= 6 + 4 * count)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    decoder->coefs[i][0] = (int16_t)le16(ext + 6 + 4 * i);
+                    decoder->coefs[i][1] = (int16_t)le16(ext + 8 + 4 * i);
+                }
+                decoder->numCoefs = count;
+            }
+        }
+        return decoder;
+    }
+
+    return nullptr;
+}
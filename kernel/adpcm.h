@@ -0,0 +1,30 @@
+#ifndef _ADPCM_H_
+#define _ADPCM_H_
+
+#include "stdint.h"
+
+// Block based ADPCM (4 bits per sample) as found in WAV files. Every block
+// starts with the full predictor state, so blocks decode independently.
+class AdpcmDecoder
+{
+public:
+    constexpr static uint16_t WAVE_FORMAT_ADPCM = 0x0002;     // Microsoft
+    constexpr static uint16_t WAVE_FORMAT_IMA_ADPCM = 0x0011; // IMA/DVI
+
+    const uint16_t channels;
+    const uint16_t blockBytes;
+    const uint16_t framesPerBlock;
+
+    AdpcmDecoder(uint16_t channels, uint16_t blockBytes, uint16_t framesPerBlock) : channels(channels), blockBytes(blockBytes), framesPerBlock(framesPerBlock) {}
+    virtual ~AdpcmDecoder() {}
+
+    // Decodes a block into 16-bit stereo frames, returns how many. bytes is
+    // less than blockBytes only for the last block of a file.
+    virtual uint32_t decode(const uint8_t *block, uint32_t bytes, int16_t *out) = 0;
+
+    // Decoder for the fmt chunk fields, null if it isn't an ADPCM format we
+    // handle. ext is the fmt extension, starting at cbSize.
+    static AdpcmDecoder *make(uint16_t formatTag, uint16_t channels, uint16_t blockAlign, const uint8_t *ext, uint32_t extBytes);
+};
+
+#endif
@@ -0,0 +1,897 @@
+#include "audio.h"
+#include "process.h"
+#include "threads.h"
+#include "blocking_lock.h"
+#include "semaphore.h"
+#include "debug.h"
+#include "pit.h"
+#include "machine.h"
+#include "prefetch.h"
+
+uint32_t AudioStream::render(int16_t *out, uint32_t frames, uint32_t outRate)
+{
+    if (playlist != nullptr)
+    {
+        return renderPlaylist(out, frames, outRate);
+    }
+    if (outRate == sampleRate)
+    {
+        return readFrames(out, frames);
+    }
+    if (resampler == nullptr || resampler->outRate != outRate)
+    {
+        delete resampler;
+        resampler = new Resampler(sampleRate, outRate);
+    }
+    return resampler->run(out, frames, [this](int16_t *buf, uint32_t n)
+                          { return readFrames(buf, n); });
+}
+
+uint32_t AudioStream::readFrames(int16_t *out, uint32_t frames)
+{
+    if (ring != nullptr)
+    {
+        return readRing(out, frames);
+    }
+    if (clip != nullptr)
+    {
+        return readClip(out, frames);
+    }
+
+    // the mixer doesn't wait for a late read-ahead: it takes what is
+    // queued, plays silence for the rest and comes back next period
+    starved = false;
+    uint32_t got = readFile(out, frames);
+    if (starved && got < frames)
+    {
+        bzero(out + got * 2, (frames - got) * 4);
+        stats.silentFrames += frames - got;
+        return frames;
+    }
+    return got;
+}
+
+bool AudioStream::waits(uint32_t n)
+{
+    if (ahead == nullptr)
+    {
+        return false;
+    }
+    // more than fits in the queue only comes by waiting anyway
+    if (n > PrefetchFile::CHUNKS * PrefetchFile::CHUNK_BYTES)
+    {
+        n = PrefetchFile::CHUNKS * PrefetchFile::CHUNK_BYTES;
+    }
+    if (ahead->ready() >= n)
+    {
+        return false;
+    }
+    starved = true;
+    return true;
+}
+
+uint32_t AudioStream::readFile(int16_t *out, uint32_t frames)
+{
+    if (flac != nullptr)
+    {
+        return readFlac(out, frames);
+    }
+    if (decoder != nullptr)
+    {
+        return readBlocks(out, frames);
+    }
+    if (format.isNative())
+    {
+        uint32_t n = frames * 4;
+        if (n > bytes)
+        {
+            n = bytes & ~3;
+        }
+        if (waits(n))
+        {
+            n = ahead->ready() & ~3;
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        auto cnt = file->read(out, n);
+        if (cnt <= 0)
+        {
+            bytes = 0;
+            return 0;
+        }
+        bytes -= cnt;
+        return cnt / 4;
+    }
+
+    // Anything else goes through the raw buffer one chunk at a time and is
+    // converted straight into out.
+    if (raw == nullptr)
+    {
+        raw = new uint32_t[RAW_BYTES / 4];
+    }
+    uint32_t frameBytes = format.frameBytes;
+    uint32_t done = 0;
+    while (done < frames)
+    {
+        uint32_t want = frames - done;
+        if (want > RAW_BYTES / frameBytes)
+        {
+            want = RAW_BYTES / frameBytes;
+        }
+        if (want > bytes / frameBytes)
+        {
+            want = bytes / frameBytes;
+        }
+        if (waits(want * frameBytes))
+        {
+            want = ahead->ready() / frameBytes;
+        }
+        if (want == 0)
+        {
+            break;
+        }
+        auto cnt = file->read(raw, want * frameBytes);
+        if (cnt <= 0)
+        {
+            bytes = 0;
+            break;
+        }
+        bytes -= cnt;
+        uint32_t got = cnt / frameBytes;
+        PCM::toStereo16(format, raw, out + done * 2, got);
+        done += got;
+        if (got < want)
+        {
+            break;
+        }
+    }
+    return done;
+}
+
+uint32_t AudioStream::readBlocks(int16_t *out, uint32_t frames)
+{
+    if (raw == nullptr)
+    {
+        raw = new uint32_t[(decoder->blockBytes + 3) / 4];
+    }
+    uint32_t done = 0;
+    while (done < frames)
+    {
+        if (pendingPos < pendingCount)
+        {
+            uint32_t n = pendingCount - pendingPos;
+            if (n > frames - done)
+            {
+                n = frames - done;
+            }
+            memcpy(out + done * 2, pending + pendingPos * 2, n * 4);
+            pendingPos += n;
+            done += n;
+            continue;
+        }
+
+        uint32_t want = bytes < decoder->blockBytes ? bytes : decoder->blockBytes;
+        if (want == 0 || waits(want))
+        {
+            break;
+        }
+        auto cnt = file->read(raw, want);
+        if (cnt <= 0)
+        {
+            bytes = 0;
+            break;
+        }
+        bytes -= cnt;
+
+        // whole blocks go straight to the caller, only the last partial one is parked
+        if (frames - done >= decoder->framesPerBlock)
+        {
+            done += decoder->decode((uint8_t *)raw, cnt, out + done * 2);
+        }
+        else
+        {
+            if (pending == nullptr)
+            {
+                pending = new int16_t[decoder->framesPerBlock * 2];
+            }
+            pendingCount = decoder->decode((uint8_t *)raw, cnt, pending);
+            pendingPos = 0;
+        }
+    }
+    return done;
+}
+
+uint32_t AudioStream::readFlac(int16_t *out, uint32_t frames)
+{
+    uint32_t done = 0;
+    while (done < frames)
+    {
+        if (flacPos == flacCount)
+        {
+            if (waits(flac->readAhead()))
+            {
+                break;
+            }
+            flacCount = flac->nextFrame();
+            flacPos = 0;
+            if (flacCount == 0)
+            {
+                break;
+            }
+        }
+        uint32_t n = flacCount - flacPos;
+        if (n > frames - done)
+        {
+            n = frames - done;
+        }
+        flac->output(out + done * 2, flacPos, n);
+        flacPos += n;
+        done += n;
+    }
+    return done;
+}
+
+uint32_t AudioStream::readRing(int16_t *out, uint32_t frames)
+{
+    // look before reading: once closed is seen, every write is in the ring
+    bool closed = ring->isClosed();
+    uint32_t got = ring->read(out, frames);
+    if (got < frames && !closed)
+    {
+        // the writer is late, keep the stream alive with silence
+        bzero(out + got * 2, (frames - got) * 4);
+        ring->underrun();
+        stats.silentFrames += frames - got;
+        return frames;
+    }
+    return got;
+}
+
+uint32_t AudioStream::readClip(int16_t *out, uint32_t frames)
+{
+    uint32_t n = clip->frames - clipPos;
+    if (n > frames)
+    {
+        n = frames;
+    }
+    memcpy(out, clip->samples + clipPos * 2, n * 4);
+    clipPos += n;
+    return n;
+}
+
+uint32_t AudioStream::renderPlaylist(int16_t *out, uint32_t frames, uint32_t outRate)
+{
+    uint32_t done = 0;
+    while (done < frames)
+    {
+        auto track = playlist->current();
+        if (track == nullptr)
+        {
+            break;
+        }
+        done += track->render(out + done * 2, frames - done, outRate);
+        if (done < frames)
+        {
+            // it ran dry, the next one picks up right here
+            track->finished = true;
+            track->done->set(0);
+            playlist->next();
+        }
+    }
+    return done;
+}
+
+bool Playlist::add(Shared<AudioStream> track)
+{
+    LockGuard<BlockingLock> g{lock};
+    if (ended || count == MAX_TRACKS)
+    {
+        return false;
+    }
+    tracks[(head + count) % MAX_TRACKS] = track;
+    count++;
+    return true;
+}
+
+Shared<AudioStream> Playlist::current()
+{
+    LockGuard<BlockingLock> g{lock};
+    if (count == 0)
+    {
+        ended = true;
+        return Shared<AudioStream>{};
+    }
+    return tracks[head];
+}
+
+void Playlist::next()
+{
+    LockGuard<BlockingLock> g{lock};
+    tracks[head] = nullptr;
+    head = (head + 1) % MAX_TRACKS;
+    count--;
+}
+
+// The software mixer
+//
+// A single kernel thread owns the PCM out ring. Every time a descriptor
+// completes it mixes the next period from all active streams into it,
+// so any number of processes (up to MAX_STREAMS) can play at once.
+//
+// The device is clocked at the rate of the stream that woke it up (or at
+// 48kHz if the codec has no VRA); streams at other rates are resampled.
+//
+// Period size and queue depth are picked again before every refill, from
+// the streams in the mix, so a low latency stream that joins a long
+// running bulk one tightens the ring within a period or two. Descriptors
+// are used round robin no matter how many are queued at a time.
+namespace Audio
+{
+    uint32_t deviceRate = 0;
+    Period devicePeriod{0, 0};
+
+    static AudioBackend *hw = nullptr;
+
+    void use(AudioBackend *backend)
+    {
+        hw = backend;
+        Debug::printf("| audio plays through %s\n", hw->name());
+    }
+
+    // Device clock. The mixer moves `head` past completed descriptors and
+    // adds their frames to `played`; position() adds whatever completed
+    // since and the part of the current descriptor already played.
+    static BlockingLock clockLock{};
+    static uint64_t playedFrames = 0;
+    static uint32_t head = 0; // oldest descriptor the hardware has not handed back yet
+    static bool dmaRunning = false;
+    // frames put in the ring, only touched by the mixer
+    static uint64_t queuedFrames = 0;
+
+    static BlockingLock lock{};
+    static Shared<AudioStream> active[MAX_STREAMS]{};
+    static bool mixerRunning = false;
+
+    // upped for every stream added to the mix
+    static Semaphore work{0};
+
+    static int32_t *accum = nullptr;
+    static int16_t *scratch = nullptr;
+
+    // instrumentation, written by the mixer
+    static BlockingLock statsLock{};
+    static DeviceStats deviceStats{};
+    static TraceEntry traceRing[TRACE_ENTRIES]{};
+    static uint32_t traced = 0;
+
+    static inline int16_t saturate(int32_t v)
+    {
+        if (v > 32767)
+            return 32767;
+        if (v < -32768)
+            return -32768;
+        return (int16_t)v;
+    }
+
+    static void finish(Shared<AudioStream> stream, uint32_t status)
+    {
+        if (stream->ring != nullptr)
+        {
+            stream->ring->detach();
+        }
+        stream->finished = true;
+        stream->done->set(status);
+    }
+
+    static uint32_t snapshot(Shared<AudioStream> *out)
+    {
+        LockGuard<BlockingLock> g{lock};
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < MAX_STREAMS; i++)
+        {
+            if (active[i] != nullptr)
+            {
+                out[n++] = active[i];
+            }
+        }
+        return n;
+    }
+
+    static void remove(Shared<AudioStream> stream)
+    {
+        LockGuard<BlockingLock> g{lock};
+        for (uint32_t i = 0; i < MAX_STREAMS; i++)
+        {
+            if (active[i] == stream)
+            {
+                active[i] = nullptr;
+            }
+        }
+    }
+
+    static void account(Shared<AudioStream> stream, uint32_t frames, uint32_t cycles)
+    {
+        LockGuard<BlockingLock> g{statsLock};
+        stream->stats.frames += frames;
+        stream->stats.periods++;
+        stream->stats.render.add(cycles);
+    }
+
+    // Picks up effects set since the last period
+    static Dsp *effects(Shared<AudioStream> stream)
+    {
+        auto fresh = stream->newDsp.exchange(nullptr);
+        if (fresh != nullptr)
+        {
+            delete stream->dsp;
+            stream->dsp = fresh;
+        }
+        return stream->dsp;
+    }
+
+    // Mixes period number `period`, `frames` long, into descriptor i
+    static void mix(uint32_t i, uint64_t period, uint32_t frames)
+    {
+        Shared<AudioStream> streams[MAX_STREAMS]{};
+        uint32_t n = snapshot(streams);
+
+        // streams that still have frames to give
+        Shared<AudioStream> live[MAX_STREAMS]{};
+        uint32_t nLive = 0;
+        for (uint32_t s = 0; s < n; s++)
+        {
+            auto stream = streams[s];
+            if (stream->stopRequested)
+            {
+                if (stream->endFrame == AudioStream::NOT_YET)
+                {
+                    stream->endFrame = queuedFrames;
+                }
+                remove(stream);
+                finish(stream, 1);
+                continue;
+            }
+            if (!stream->drained)
+            {
+                live[nLive++] = stream;
+            }
+        }
+
+        if (hw->resizable())
+        {
+            hw->setFrames(i, frames);
+        }
+        frames = hw->frames(i);
+        int16_t *dst = hw->buffer(i);
+
+        uint64_t base = queuedFrames;
+        queuedFrames += frames;
+
+        // Streams with a start time sit out the periods before it and begin
+        // `skip` frames into the one holding it
+        uint32_t skip[MAX_STREAMS];
+        uint32_t nPlaying = 0;
+        for (uint32_t s = 0; s < nLive; s++)
+        {
+            auto stream = live[s];
+            uint64_t at = stream->startAt;
+            if (at != AudioStream::NOT_YET && at >= base + frames)
+            {
+                continue;
+            }
+            uint32_t k = (at != AudioStream::NOT_YET && at > base) ? (uint32_t)(at - base) : 0;
+            if (stream->startFrame == AudioStream::NOT_YET)
+            {
+                stream->startFrame = base + k;
+            }
+            live[nPlaying] = stream;
+            skip[nPlaying] = k;
+            nPlaying++;
+        }
+        nLive = nPlaying;
+
+        // A lone stream at unity gain has nothing to mix with, so it renders
+        // straight into the DMA buffer. For 16-bit stereo at the device rate
+        // that is a file read, and whole disk blocks land there without any
+        // copy in between.
+        if (nLive == 1 && skip[0] == 0 && (effects(live[0]) != nullptr || live[0]->gain == UNITY_GAIN))
+        {
+            auto stream = live[0];
+            uint32_t t0 = (uint32_t)rdtsc();
+            uint32_t got = stream->render(dst, frames, deviceRate);
+            if (stream->dsp != nullptr)
+            {
+                stream->dsp->run(dst, got, stream->gain);
+            }
+            account(stream, got, (uint32_t)rdtsc() - t0);
+            if (got < frames)
+            {
+                stream->drained = true;
+                stream->lastPeriod = period;
+                stream->endFrame = base + got;
+                bzero(dst + got * 2, (frames - got) * 4);
+            }
+            return;
+        }
+
+        for (uint32_t k = 0; k < frames * 2; k++)
+        {
+            accum[k] = 0;
+        }
+
+        for (uint32_t s = 0; s < nLive; s++)
+        {
+            auto stream = live[s];
+            uint32_t want = frames - skip[s];
+            uint32_t t0 = (uint32_t)rdtsc();
+            uint32_t got = stream->render(scratch, want, deviceRate);
+            if (got < want)
+            {
+                stream->drained = true;
+                stream->lastPeriod = period;
+                stream->endFrame = base + skip[s] + got;
+            }
+            int32_t gain = stream->gain;
+            auto dsp = effects(stream);
+            if (dsp != nullptr)
+            {
+                dsp->run(scratch, got, gain);
+                gain = UNITY_GAIN;
+            }
+            account(stream, got, (uint32_t)rdtsc() - t0);
+            int32_t *out = accum + skip[s] * 2;
+            for (uint32_t k = 0; k < got * 2; k++)
+            {
+                out[k] += (scratch[k] * gain) >> 15;
+            }
+        }
+
+        for (uint32_t k = 0; k < frames * 2; k++)
+        {
+            dst[k] = saturate(accum[k]);
+        }
+    }
+
+    // mix() plus its cost
+    static void refill(uint32_t i, uint64_t period, uint32_t frames)
+    {
+        uint32_t t0 = (uint32_t)rdtsc();
+        mix(i, period, frames);
+        uint32_t cycles = (uint32_t)rdtsc() - t0;
+
+        LockGuard<BlockingLock> g{statsLock};
+        deviceStats.periods++;
+        deviceStats.refill.add(cycles);
+    }
+
+    static void record(uint32_t wakeup, uint64_t played, uint64_t queued)
+    {
+        uint32_t civ;
+        uint32_t left = hw->position(civ);
+
+        LockGuard<BlockingLock> g{statsLock};
+        deviceStats.wakeup.add(wakeup);
+        auto &e = traceRing[traced++ % TRACE_ENTRIES];
+        e.tsc = (uint32_t)rdtsc();
+        e.played = (uint32_t)played;
+        e.civ = civ;
+        e.picb = left * 2;
+        e.queued = (uint32_t)(queued - played);
+    }
+
+    // Completes drained streams whose last period has been played.
+    // Returns true if nothing is left to play.
+    static bool retire(uint64_t played)
+    {
+        Shared<AudioStream> streams[MAX_STREAMS]{};
+        uint32_t n = snapshot(streams);
+        uint32_t left = n;
+        for (uint32_t s = 0; s < n; s++)
+        {
+            auto stream = streams[s];
+            if (stream->drained && stream->lastPeriod < played)
+            {
+                remove(stream);
+                finish(stream, 0);
+                left--;
+            }
+        }
+        return left == 0;
+    }
+
+    static uint32_t pickRate()
+    {
+        LockGuard<BlockingLock> g{lock};
+        for (uint32_t i = 0; i < MAX_STREAMS; i++)
+        {
+            if (active[i] != nullptr)
+            {
+                return active[i]->sampleRate;
+            }
+        }
+        return 0;
+    }
+
+    // The smallest period and the shallowest queue anyone asked for, the
+    // default if nobody did. hw->start() lowers what the device can't do.
+    static Period pickPeriod()
+    {
+        LockGuard<BlockingLock> g{lock};
+        Period p{MAX_PERIOD_FRAMES, MAX_PERIODS};
+        bool asked = false;
+        for (uint32_t i = 0; i < MAX_STREAMS; i++)
+        {
+            auto stream = active[i];
+            if (stream != nullptr && !stream->drained && stream->period.count != 0)
+            {
+                asked = true;
+                if (stream->period.frames < p.frames)
+                    p.frames = stream->period.frames;
+                if (stream->period.count < p.count)
+                    p.count = stream->period.count;
+            }
+        }
+        return asked ? p : DEFAULT_PERIOD;
+    }
+
+    static void mixer()
+    {
+        accum = new int32_t[MAX_PERIOD_FRAMES * 2];
+        scratch = new int16_t[MAX_PERIOD_FRAMES * 2];
+
+        while (true)
+        {
+            work.down();
+            uint32_t rate = pickRate();
+            if (rate == 0)
+            {
+                // everything we were woken up for is already gone
+                continue;
+            }
+
+            devicePeriod = pickPeriod();
+            deviceRate = hw->start(rate, devicePeriod.frames, devicePeriod.count);
+            uint64_t queued = 0;
+            uint64_t played = 0;
+            {
+                LockGuard<BlockingLock> g{statsLock};
+                deviceStats.runs++;
+            }
+            for (uint32_t i = 0; i < devicePeriod.count; i++)
+            {
+                refill(i, queued++, devicePeriod.frames);
+            }
+            {
+                LockGuard<BlockingLock> g{clockLock};
+                hw->run(devicePeriod.count - 1);
+                dmaRunning = true;
+            }
+
+            // the descriptor the next period goes into
+            uint32_t tail = devicePeriod.count % hw->slots();
+            bool idle = false;
+            while (!idle)
+            {
+                hw->waitForBuffer();
+                uint32_t wakeup = (uint32_t)rdtsc() - hw->completedAt();
+                uint32_t civ;
+                hw->position(civ);
+                {
+                    LockGuard<BlockingLock> g{clockLock};
+                    while (head != civ)
+                    {
+                        played++;
+                        playedFrames += hw->frames(head);
+                        head = (head + 1) % hw->slots();
+                    }
+                }
+                record(wakeup, played, queued);
+                idle = retire(played);
+
+                // a ring that loops on its own keeps what it started with
+                if (hw->resizable())
+                {
+                    devicePeriod = pickPeriod();
+                }
+                while (!idle && queued - played < devicePeriod.count)
+                {
+                    refill(tail, queued++, devicePeriod.frames);
+                    hw->setLastValid(tail);
+                    tail = (tail + 1) % hw->slots();
+                }
+            }
+            {
+                // whatever is still queued is silence and never plays. The
+                // clock keeps what position() may have reported of it: the
+                // next run has to start after that, not reuse the frames.
+                LockGuard<BlockingLock> g{clockLock};
+                uint32_t civ;
+                uint32_t left = hw->position(civ);
+                while (head != civ)
+                {
+                    playedFrames += hw->frames(head);
+                    head = (head + 1) % hw->slots();
+                }
+                playedFrames += hw->frames(civ) - left;
+                hw->halt();
+                dmaRunning = false;
+                deviceRate = 0;
+                devicePeriod = Period{0, 0};
+                queuedFrames = playedFrames;
+                head = 0;
+            }
+        }
+    }
+
+    static Shared<AudioStream> add(Shared<AudioStream> stream)
+    {
+        if (hw == nullptr)
+        {
+            return Shared<AudioStream>{};
+        }
+        stream->period = gheith::current()->process->audioPeriod;
+        bool added = false;
+        bool startMixer = false;
+        {
+            LockGuard<BlockingLock> g{lock};
+            for (uint32_t i = 0; i < MAX_STREAMS; i++)
+            {
+                if (active[i] == nullptr)
+                {
+                    active[i] = stream;
+                    added = true;
+                    break;
+                }
+            }
+            if (added && !mixerRunning)
+            {
+                mixerRunning = true;
+                startMixer = true;
+            }
+        }
+        if (!added)
+        {
+            return Shared<AudioStream>{};
+        }
+        if (startMixer)
+        {
+            thread(Process::kernelProcess, []
+                   { mixer(); });
+        }
+        work.up();
+        return stream;
+    }
+
+    Shared<AudioStream> open(Shared<File> file, const PCM::Format &format, uint32_t sampleRate, uint32_t bytes, AdpcmDecoder *decoder)
+    {
+        return Shared<AudioStream>::make(file, bytes, sampleRate, format, decoder);
+    }
+
+    Shared<AudioStream> open(Shared<File> file, FlacDecoder *flac)
+    {
+        PCM::Format format{0, 2, 16, 4};
+        auto stream = Shared<AudioStream>::make(file, 0, flac->sampleRate, format, nullptr);
+        stream->flac = flac;
+        return stream;
+    }
+
+    Shared<AudioStream> play(Shared<AudioStream> stream)
+    {
+        return add(stream);
+    }
+
+    Shared<AudioStream> play(Shared<AudioStream> stream, uint64_t at)
+    {
+        stream->startAt = at;
+        return add(stream);
+    }
+
+    Shared<AudioStream> play(Shared<AudioRing> ring)
+    {
+        PCM::Format format{PCM::WAVE_FORMAT_PCM, 2, 16, 4};
+        auto stream = Shared<AudioStream>::make(Shared<File>{}, 0, ring->rate(), format, nullptr);
+        stream->ring = ring;
+        ring->attach();
+        return add(stream);
+    }
+
+    Shared<AudioStream> open(Shared<SoundCache::Clip> clip)
+    {
+        PCM::Format format{PCM::WAVE_FORMAT_PCM, 2, 16, 4};
+        auto stream = Shared<AudioStream>::make(Shared<File>{}, 0, clip->rate, format, nullptr);
+        stream->clip = clip;
+        return stream;
+    }
+
+    Shared<AudioStream> play(Shared<Playlist> playlist, Shared<AudioStream> first)
+    {
+        PCM::Format format{PCM::WAVE_FORMAT_PCM, 2, 16, 4};
+        auto stream = Shared<AudioStream>::make(Shared<File>{}, 0, first->sampleRate, format, nullptr);
+        stream->playlist = playlist;
+        playlist->add(first);
+        return add(stream);
+    }
+
+    void position(Position &out)
+    {
+        LockGuard<BlockingLock> g{clockLock};
+        out.frames = playedFrames;
+        out.rate = dmaRunning ? deviceRate : 0;
+        if (dmaRunning)
+        {
+            uint32_t civ;
+            uint32_t left = hw->position(civ);
+            for (uint32_t i = head; i != civ; i = (i + 1) % hw->slots())
+            {
+                out.frames += hw->frames(i);
+            }
+            out.frames += hw->frames(civ) - left;
+        }
+        out.tsc = rdtsc();
+        out.jiffies = Pit::jiffies;
+    }
+
+    void position(Shared<AudioStream> stream, Position &out)
+    {
+        position(out);
+        uint64_t start = stream->startFrame;
+        uint64_t end = stream->endFrame;
+        if (start == AudioStream::NOT_YET || out.frames < start)
+        {
+            out.frames = 0;
+            return;
+        }
+        if (end != AudioStream::NOT_YET && out.frames > end)
+        {
+            out.frames = end;
+        }
+        out.frames -= start;
+    }
+
+    void stats(Shared<AudioStream> stream, DeviceStats &device, StreamStats &out)
+    {
+        LockGuard<BlockingLock> g{statsLock};
+        device = deviceStats;
+        if (hw != nullptr)
+        {
+            device.lastValidEvents = hw->lastValidEvents();
+            device.fifoErrors = hw->fifoErrors();
+        }
+        if (stream != nullptr)
+        {
+            out = stream->stats;
+        }
+        else
+        {
+            bzero(&out, sizeof(out));
+        }
+    }
+
+    uint32_t trace(TraceEntry *out, uint32_t max)
+    {
+        LockGuard<BlockingLock> g{statsLock};
+        uint32_t n = traced < TRACE_ENTRIES ? traced : TRACE_ENTRIES;
+        if (n > max)
+        {
+            n = max;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            out[i] = traceRing[(traced - n + i) % TRACE_ENTRIES];
+        }
+        return n;
+    }
+
+    void stop(Shared<AudioStream> stream)
+    {
+        stream->stopRequested = true;
+        stream->wait();
+    }
+
+    void cancel(Shared<AudioStream> stream)
+    {
+        stream->stopRequested = true;
+    }
+}
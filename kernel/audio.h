@@ -0,0 +1,344 @@
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include "atomic.h"
+#include "stdint.h"
+#include "shared.h"
+#include "future.h"
+#include "file.h"
+#include "resample.h"
+#include "pcm.h"
+#include "adpcm.h"
+#include "flac.h"
+#include "audioring.h"
+#include "soundcache.h"
+#include "blocking_lock.h"
+#include "dsp.h"
+#include "audiobackend.h"
+
+namespace Audio
+{
+    // How a stream wants the DMA ring carved up: `count` periods of
+    // `frames` each may be queued ahead of the hardware. Few short periods
+    // keep latency down, many long ones keep the mixer asleep. All streams
+    // share one ring, so it runs with the smallest of each that was asked
+    // for, and with DEFAULT_PERIOD if nobody asked.
+    struct Period
+    {
+        uint32_t frames;
+        uint32_t count;
+    };
+
+    // The ring may end up smaller than asked for: the device lowers what
+    // it can't do (AC97 has 32 descriptors, HDA 256 in a fixed number of
+    // bytes)
+    constexpr uint32_t MIN_PERIOD_FRAMES = 32;
+    constexpr uint32_t MAX_PERIOD_FRAMES = 2048;
+    constexpr uint32_t MIN_PERIODS = 2;
+    constexpr uint32_t MAX_PERIODS = 256;
+    constexpr Period DEFAULT_PERIOD{MAX_PERIOD_FRAMES, 32};
+    // for processes that never called audio_period
+    constexpr Period NO_PERIOD{0, 0};
+
+    inline bool isValid(const Period &p)
+    {
+        return p.frames >= MIN_PERIOD_FRAMES && p.frames <= MAX_PERIOD_FRAMES &&
+               p.count >= MIN_PERIODS && p.count <= MAX_PERIODS;
+    }
+
+    // Instrumentation. Times are in TSC cycles; audio_position samples the
+    // TSC and jiffies together, which is enough to convert them.
+
+    // Powers of two: bucket 0 counts everything under 2^(SHIFT + 1)
+    // cycles, bucket b >= 1 counts [2^(SHIFT + b), 2^(SHIFT + b + 1)) and
+    // the last one everything above that too
+    struct Histogram
+    {
+        constexpr static uint32_t BUCKETS = 16;
+        constexpr static uint32_t SHIFT = 10;
+
+        uint32_t count[BUCKETS];
+        uint32_t max;
+
+        void add(uint32_t cycles)
+        {
+            uint32_t scaled = cycles >> SHIFT;
+            uint32_t b = scaled == 0 ? 0 : 31 - __builtin_clz(scaled);
+            if (b >= BUCKETS)
+            {
+                b = BUCKETS - 1;
+            }
+            count[b]++;
+            if (cycles > max)
+            {
+                max = cycles;
+            }
+        }
+    };
+
+    struct StreamStats
+    {
+        uint64_t frames;        // handed to the mixer (16-bit stereo, so 4 bytes each)
+        uint32_t silentFrames;  // made up because a /dev/audio or mapped writer, or the disk, was late
+        uint32_t periods;       // the stream was rendered in
+        Histogram render;       // cycles to render (decode, convert, resample, effects) a period
+    };
+
+    struct DeviceStats
+    {
+        uint32_t runs;            // times the DMA engine was started
+        uint32_t periods;         // refilled
+        uint32_t lastValidEvents; // the hardware reached the last valid buffer: it ran dry
+                                  // (includes the end of every run)
+        uint32_t fifoErrors;
+        Histogram refill;         // cycles to mix a period
+        Histogram wakeup;         // cycles from a buffer completing to the mixer running
+    };
+
+    // One per refill: where the hardware was when the mixer woke up
+    struct TraceEntry
+    {
+        uint32_t tsc;    // low half
+        uint32_t played; // periods completed this run
+        uint16_t civ;
+        uint16_t picb;   // samples left in descriptor civ
+        uint32_t queued; // periods in the ring, including civ's
+    };
+    constexpr uint32_t TRACE_ENTRIES = 128;
+}
+
+class AudioStream;
+class PrefetchFile;
+
+// Tracks played back to back by one stream (see Audio::play). The mixer
+// moves from the last frame of one straight into the next within the same
+// period, so there is no gap and the device is never restarted; tracks at
+// another rate than the device are resampled like any other stream.
+class Playlist
+{
+public:
+    constexpr static uint32_t MAX_TRACKS = 16;
+
+private:
+    Atomic<uint32_t> ref_count{0};
+    BlockingLock lock{};
+    Shared<AudioStream> tracks[MAX_TRACKS]{};
+    uint32_t head = 0;
+    uint32_t count = 0;
+    bool ended = false;
+
+public:
+    // false if the queue is full, or it already ran dry and the stream ended
+    bool add(Shared<AudioStream> track);
+
+    // The track playing now, null (and the playlist is over) if none is left
+    Shared<AudioStream> current();
+
+    // Done with the current track
+    void next();
+
+    friend class Shared<Playlist>;
+};
+
+// One playback request. The mixer pulls frames from every active stream
+// while the process that started it keeps running; the process holds a
+// handle to it (see Process::newStream).
+class AudioStream
+{
+    Atomic<uint32_t> ref_count{0};
+
+public:
+    Shared<File> file;
+    uint32_t bytes;      // PCM bytes left in the data chunk
+    uint32_t sampleRate;
+    PCM::Format format;  // layout of the data chunk
+
+    // taken from the opening process (see the audio_period system call)
+    Audio::Period period = Audio::NO_PERIOD;
+
+    // kept by the mixer
+    Audio::StreamStats stats{};
+
+    // Q15 gain applied while mixing, 0x8000 is unity
+    volatile uint32_t gain = 0x8000;
+
+    // Effects, owned by the mixer thread; once a stream has them they ramp
+    // the gain too. New settings wait in newDsp until the next period.
+    Dsp *dsp = nullptr;
+    Atomic<Dsp *> newDsp{nullptr};
+
+    // set once by the mixer: 0 -> played to the end, 1 -> stopped early
+    Shared<Future<uint32_t>> done = Shared<Future<uint32_t>>::make();
+    volatile bool finished = false;
+    volatile bool stopRequested = false;
+
+    // process handles to it (see Process::newStream), it stops once the
+    // last one is closed
+    Atomic<uint32_t> handles{0};
+
+    // mixer bookkeeping: once the source runs dry the stream stays around
+    // until the hardware has played the period holding its last frame
+    bool drained = false;
+    uint64_t lastPeriod = 0;
+
+    // where the stream's first and (once drained) one past its last frame
+    // fall on the device clock, see Audio::position
+    constexpr static uint64_t NOT_YET = ~uint64_t(0);
+    uint64_t startFrame = NOT_YET;
+    uint64_t endFrame = NOT_YET;
+
+    // device frame the stream's first frame has to play at, NOT_YET to
+    // start with the next period. Set before the stream is played.
+    uint64_t startAt = NOT_YET;
+
+    // only set when the device runs at a different rate than the stream
+    Resampler *resampler = nullptr;
+
+    // file data waiting for conversion, only used when the format isn't native
+    constexpr static uint32_t RAW_BYTES = 8192;
+    uint32_t *raw = nullptr;
+
+    // compressed streams: the decoder, and what's left of a block that
+    // didn't fit in the caller's buffer
+    AdpcmDecoder *decoder;
+    int16_t *pending = nullptr;
+    uint32_t pendingPos = 0;
+    uint32_t pendingCount = 0;
+
+    // FLAC streams: the decoder reads the file itself, and holds the
+    // current frame until all of it has been handed out
+    FlacDecoder *flac = nullptr;
+    uint32_t flacPos = 0;
+    uint32_t flacCount = 0;
+
+    // /dev/audio streams read from the ring a process writes into
+    Shared<AudioRing> ring;
+
+    // cached clips are already decoded, the stream only walks through them
+    Shared<SoundCache::Clip> clip;
+    uint32_t clipPos = 0;
+
+    // playlist streams render their tracks, one after the other
+    Shared<Playlist> playlist;
+
+    // the read-ahead the file (or FLAC decoder) reads through, if any. The
+    // mixer never reads past what it holds; `starved` says it stopped short.
+    PrefetchFile *ahead = nullptr;
+    bool starved = false;
+
+    AudioStream(Shared<File> file, uint32_t bytes, uint32_t sampleRate, const PCM::Format &format, AdpcmDecoder *decoder) : file(file), bytes(bytes), sampleRate(sampleRate), format(format), decoder(decoder) {}
+    ~AudioStream()
+    {
+        delete resampler;
+        delete[] raw;
+        delete decoder;
+        delete[] pending;
+        delete flac;
+        delete dsp;
+        delete newDsp.exchange(nullptr);
+    }
+
+    // Produce up to `frames` 16-bit stereo frames at `outRate`, returns how many were produced
+    uint32_t render(int16_t *out, uint32_t frames, uint32_t outRate);
+
+    // Frames from the data chunk converted to 16-bit stereo, at sampleRate
+    uint32_t readFrames(int16_t *out, uint32_t frames);
+    uint32_t readFile(int16_t *out, uint32_t frames);
+
+    // true (and the stream is starved) if reading n bytes would wait for the disk
+    bool waits(uint32_t n);
+
+    // readFrames for compressed streams
+    uint32_t readBlocks(int16_t *out, uint32_t frames);
+    uint32_t readFlac(int16_t *out, uint32_t frames);
+    uint32_t readRing(int16_t *out, uint32_t frames);
+    uint32_t readClip(int16_t *out, uint32_t frames);
+
+    // render() for playlists
+    uint32_t renderPlaylist(int16_t *out, uint32_t frames, uint32_t outRate);
+
+    uint32_t wait() { return done->get(); }
+
+    friend class Shared<AudioStream>;
+};
+
+namespace Audio
+{
+    constexpr uint32_t MAX_STREAMS = 8;
+    constexpr uint32_t UNITY_GAIN = 0x8000;
+
+    // The sound card the mixer plays through, set once at boot
+    extern void use(AudioBackend *hw);
+
+    // rate the hardware is currently clocked at, 0 when idle
+    extern uint32_t deviceRate;
+
+    // Period size and queue depth the ring is running with, 0 when idle
+    extern Period devicePeriod;
+
+    // The device clock counts frames the hardware has played since boot,
+    // at whatever rate it was running at the time. `jiffies` and `tsc` are
+    // sampled together with the DMA position. `rate` is 0 while idle, when
+    // the clock stands still.
+    struct Position
+    {
+        uint64_t frames;
+        uint64_t tsc;
+        uint32_t jiffies;
+        uint32_t rate;
+    };
+
+    // Exact to the sample: buffers the hardware completed, plus how far
+    // it is into the current one (CIV and PICB on AC97, the DMA position
+    // buffer on HDA)
+    extern void position(Position &out);
+
+    // The same, counted from the stream's first frame. Stays at 0 until
+    // the stream is mixed and stops at its last frame.
+    extern void position(Shared<AudioStream> stream, Position &out);
+
+    // Counters since boot, and the stream's own if it's not null
+    extern void stats(Shared<AudioStream> stream, DeviceStats &device, StreamStats &out);
+
+    // Copies out up to `max` of the most recent trace entries, oldest
+    // first. Returns how many.
+    extern uint32_t trace(TraceEntry *out, uint32_t max);
+
+    // A stream for `bytes` of data in `format`, decoded by `decoder` if
+    // it's compressed (the stream takes it over). The file offset must be
+    // at the start of the data chunk. Nothing plays until it's passed to
+    // play().
+    extern Shared<AudioStream> open(Shared<File> file, const PCM::Format &format, uint32_t sampleRate, uint32_t bytes, AdpcmDecoder *decoder = nullptr);
+
+    // Same for an opened FLAC stream, which the audio stream takes over
+    extern Shared<AudioStream> open(Shared<File> file, FlacDecoder *flac);
+
+    // Same for a cached clip
+    extern Shared<AudioStream> open(Shared<SoundCache::Clip> clip);
+
+    // Adds the stream to the mix, returns null if the mixer is full.
+    // Streams get the period settings of the process that starts them.
+    extern Shared<AudioStream> play(Shared<AudioStream> stream);
+
+    // Plays it starting exactly at device frame `at` (see position()): the
+    // mixer leaves it out until the period holding that frame and starts it
+    // that many frames in. Streams given the same frame start together. The
+    // clock only runs while the device does, so while idle `at` counts from
+    // where it stopped. Frames already queued can't change; if `at` is
+    // earlier than the end of the ring the stream starts as soon as it can.
+    extern Shared<AudioStream> play(Shared<AudioStream> stream, uint64_t at);
+
+    // Same for 16-bit stereo PCM written into `ring`
+    extern Shared<AudioStream> play(Shared<AudioRing> ring);
+
+    // Same for a playlist, starting with `first` (more can be added to
+    // the playlist while it plays)
+    extern Shared<AudioStream> play(Shared<Playlist> playlist, Shared<AudioStream> first);
+
+    // Takes the stream out of the mix and waits until the mixer let go of it
+    extern void stop(Shared<AudioStream> stream);
+    // The same without waiting, the mixer drops it at its next period
+    extern void cancel(Shared<AudioStream> stream);
+}
+
+#endif
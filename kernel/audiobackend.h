@@ -0,0 +1,62 @@
+#ifndef _AUDIOBACKEND_H_
+#define _AUDIOBACKEND_H_
+
+#include "stdint.h"
+
+// What the mixer needs from a sound card: a ring of DMA buffers ("slots")
+// of 16-bit stereo that the device plays in order, interrupting as each
+// one completes. The mixer fills a slot, hands it over with setLastValid()
+// and refills it once the device has moved past it.
+class AudioBackend
+{
+public:
+    virtual ~AudioBackend() {}
+
+    virtual const char *name() = 0;
+
+    // Most slots and the most frames in one slot the device can take
+    virtual uint32_t maxSlots() = 0;
+    virtual uint32_t maxFrames() = 0;
+
+    // Gets ready to play at (close to) `rate` with `count` slots of
+    // `frames` each, lowering either if they are more than the device can
+    // do. Returns the rate the device actually runs at. The caller fills
+    // slots 0 .. count - 1 and then calls run().
+    virtual uint32_t start(uint32_t rate, uint32_t &frames, uint32_t &count) = 0;
+    virtual void run(uint32_t lastValid) = 0;
+
+    // How many slots the ring has while running, the mixer moves around it
+    // modulo this
+    virtual uint32_t slots() = 0;
+
+    // Whether slot lengths and how many slots are queued can change while
+    // running. If not, the ring plays round and round with what start()
+    // settled on and every slot has to be refilled in time.
+    virtual bool resizable() = 0;
+
+    // Where slot i's samples go, and how many frames it holds
+    virtual int16_t *buffer(uint32_t i) = 0;
+    virtual uint32_t frames(uint32_t i) = 0;
+    // Only for resizable devices
+    virtual void setFrames(uint32_t i, uint32_t frames) = 0;
+
+    // Slot i is full. Devices that stop at the last valid slot start again
+    // if they ran dry; devices that loop around the ring regardless ignore it.
+    virtual void setLastValid(uint32_t i) = 0;
+
+    // The slot being played and the frames it has left, consistent
+    // with each other
+    virtual uint32_t position(uint32_t &current) = 0;
+
+    // Blocks until a slot completes (or the device ran dry)
+    virtual void waitForBuffer() = 0;
+    virtual void halt() = 0;
+
+    // Kept by the interrupt handler: low half of the TSC when a slot last
+    // completed, how often the device ran dry and FIFO errors
+    virtual uint32_t completedAt() = 0;
+    virtual uint32_t lastValidEvents() = 0;
+    virtual uint32_t fifoErrors() = 0;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "audiodev.h"
+#include "ac97.h"
+#include "atomic.h"
+
+ssize_t AudioDevFile::write(void *buffer, size_t n)
+{
+    LockGuard<BlockingLock> g{lock};
+
+    if (stream == nullptr || stream->finished)
+    {
+        stream = Audio::play(ring);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+    }
+    return ring->write(buffer, n);
+}
+
+static Atomic<bool> captureOpen{false};
+
+Shared<File> AudioInFile::open()
+{
+    if (!AC97::present() || captureOpen.exchange(true))
+    {
+        return Shared<File>{};
+    }
+    // nothing here resamples, so the codec has to run at RATE
+    if (AC97::setCaptureRate(RATE) != RATE)
+    {
+        captureOpen.set(false);
+        return Shared<File>{};
+    }
+    return Shared<File>{new AudioInFile()};
+}
+
+AudioInFile::~AudioInFile()
+{
+    if (running)
+    {
+        AC97::stopCapture();
+    }
+    captureOpen.set(false);
+}
+
+ssize_t AudioInFile::read(void *buffer, size_t n)
+{
+    LockGuard<BlockingLock> g{lock};
+
+    if (!running)
+    {
+        if (AC97::startCapture(RATE) != RATE)
+        {
+            AC97::stopCapture();
+            return -1;
+        }
+        running = true;
+        holding = false;
+        index = 0;
+        offset = 0;
+    }
+    if (!holding)
+    {
+        AC97::waitForCapture(index);
+        holding = true;
+    }
+
+    uint32_t have = AC97::CAPTURE_SAMPLES * sizeof(int16_t) - offset;
+    uint32_t cnt = (n & ~3) < have ? (n & ~3) : have;
+    memcpy(buffer, (char *)AC97::captureBuffer(index) + offset, cnt);
+    offset += cnt;
+
+    if (offset == AC97::CAPTURE_SAMPLES * sizeof(int16_t))
+    {
+        // done with it, the hardware can fill it again
+        AC97::releaseCapture(index);
+        index = (index + 1) % AC97::CAPTURE_BUFFERS;
+        holding = false;
+        offset = 0;
+    }
+    return cnt;
+}
@@ -0,0 +1,70 @@
+#ifndef _AUDIODEV_H_
+#define _AUDIODEV_H_
+
+#include "file.h"
+#include "audio.h"
+#include "blocking_lock.h"
+
+// /dev/audio: write() 16-bit stereo PCM at AudioDevFile::RATE and it gets
+// mixed with everything else that's playing. Writes only block while the
+// kernel side ring is full. Playback starts with the first write and ends
+// once the last descriptor is closed and the ring has drained.
+class AudioDevFile : public File
+{
+    Shared<AudioRing> ring;
+    Shared<AudioStream> stream;
+    BlockingLock lock;
+
+public:
+    constexpr static const char *PATH = "/dev/audio";
+    constexpr static uint32_t RATE = 48000;
+
+    AudioDevFile() : ring(Shared<AudioRing>::make(RATE)) {}
+    ~AudioDevFile() { ring->close(); }
+
+    bool isU8250() override { return false; }
+    bool isFile() override { return false; }
+    bool isDirectory() override { return false; }
+    off_t size() override { return 0; }
+    off_t seek(off_t offset) override { return -1; }
+    off_t getOffset() override { return 0; }
+    ssize_t read(void *buffer, size_t n) override { return -1; }
+    ssize_t write(void *buffer, size_t n) override;
+
+    // false if there was no DMA memory for the ring
+    bool isReady() { return !ring->isNull(); }
+};
+
+// /dev/audioin: read() returns 16-bit stereo PCM captured from the codec's
+// line in at AudioInFile::RATE. A read blocks until the next capture buffer
+// completes and returns at most the rest of that buffer. Only one process
+// can have it open; capture runs from the first read until it is closed.
+class AudioInFile : public File
+{
+    bool running = false;
+    bool holding = false; // buffer `index` is complete and not handed back yet
+    uint32_t index = 0;
+    uint32_t offset = 0;  // bytes of buffer `index` already returned
+    BlockingLock lock;
+
+public:
+    constexpr static const char *PATH = "/dev/audioin";
+    constexpr static uint32_t RATE = 48000;
+
+    // nullptr if someone else is already capturing, there is no AC97 or
+    // it can't capture at RATE
+    static Shared<File> open();
+
+    ~AudioInFile();
+
+    bool isU8250() override { return false; }
+    bool isFile() override { return false; }
+    bool isDirectory() override { return false; }
+    off_t size() override { return 0; }
+    off_t seek(off_t offset) override { return -1; }
+    off_t getOffset() override { return 0; }
+    ssize_t read(void *buffer, size_t n) override;
+    ssize_t write(void *buffer, size_t n) override { return -1; }
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef _AUDIORING_H_
+#define _AUDIORING_H_
+
+#include "stdint.h"
+#include "atomic.h"
+#include "semaphore.h"
+#include "machine.h"
+#include "dma.h"
+#include "physmem.h"
+
+// Positions of an AudioRing. This page is shared with user space when the
+// ring is mapped (see Process::mapAudio), so the layout is ABI: it matches
+// struct audio_ring in the user's sys.h.
+struct AudioRingControl
+{
+    volatile uint32_t head;      // bytes consumed by the mixer
+    volatile uint32_t tail;      // bytes produced by the application
+    uint32_t bytes;              // size of the sample area
+    uint32_t rate;               // frames per second, 16-bit stereo
+    volatile uint32_t underruns; // periods the mixer had to fill with silence
+};
+
+// Single producer / single consumer ring of 16-bit stereo PCM.
+//
+// The producer is a process (writing to /dev/audio, or storing straight
+// into a mapped ring), the consumer is the mixer. Neither takes a lock:
+// head and tail are free running byte counts and each side only ever
+// stores its own. A producer that wants to wait for room blocks on
+// `space`; the consumer ups it after making room if the producer said it
+// was waiting.
+//
+// The control page and the samples are one DMA region, page aligned, so
+// they can be mapped into a process as is: control at the start, samples
+// from the next page on.
+class AudioRing
+{
+    Atomic<uint32_t> ref_count{0};
+
+public:
+    constexpr static uint32_t BYTES = 16384; // power of two, whole pages
+
+private:
+    DMA::Region region;
+    AudioRingControl *control = nullptr;
+    uint8_t *data = nullptr;
+    bool writerWaiting = false;
+    bool closed = false;       // the producer is done
+    bool consumerGone = false; // the stream stopped, nobody will make room
+    Semaphore space{0};
+
+    // the control page may be written by user space, so never trust it further than BYTES
+    inline uint32_t used()
+    {
+        uint32_t n = __atomic_load_n(&control->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&control->head, __ATOMIC_ACQUIRE);
+        return n > BYTES ? BYTES : n;
+    }
+
+    // blocks until there is room or there never will be, false in that case
+    bool waitForRoom(uint32_t bytes)
+    {
+        while (BYTES - used() < bytes)
+        {
+            if (__atomic_load_n(&consumerGone, __ATOMIC_ACQUIRE))
+            {
+                return false;
+            }
+            __atomic_store_n(&writerWaiting, true, __ATOMIC_SEQ_CST);
+            // the consumer may have made room before it could see the flag
+            if (BYTES - used() < bytes && !__atomic_load_n(&consumerGone, __ATOMIC_SEQ_CST))
+            {
+                space.down();
+            }
+        }
+        return true;
+    }
+
+public:
+    AudioRing(uint32_t rate)
+    {
+        region = DMA::alloc(PhysMem::FRAME_SIZE + BYTES, PhysMem::FRAME_SIZE);
+        if (!region.isNull())
+        {
+            control = region.virt<AudioRingControl>();
+            data = region.virt<uint8_t>() + PhysMem::FRAME_SIZE;
+            control->bytes = BYTES;
+            control->rate = rate;
+        }
+    }
+
+    ~AudioRing() { DMA::free(region); }
+
+    AudioRing(const AudioRing &) = delete;
+
+    bool isNull() { return control == nullptr; }
+
+    uint32_t rate() { return control->rate; }
+
+    // for mapping: the whole region, control page first
+    uint32_t phys() { return region.phys(); }
+    uint32_t pages() { return region.bytes / PhysMem::FRAME_SIZE; }
+
+    // Copies the bytes in, blocking while the ring is full. Returns how
+    // many went in, short only if the stream was stopped.
+    uint32_t write(const void *buf, uint32_t n)
+    {
+        const uint8_t *src = (const uint8_t *)buf;
+        uint32_t done = 0;
+        while (done < n)
+        {
+            if (!waitForRoom(1))
+            {
+                break;
+            }
+            uint32_t room = BYTES - used();
+            uint32_t c = room < (n - done) ? room : (n - done);
+            uint32_t tail = control->tail;
+            uint32_t at = tail & (BYTES - 1);
+            uint32_t first = (BYTES - at) < c ? (BYTES - at) : c;
+            memcpy(data + at, src + done, first);
+            memcpy(data, src + done + first, c - first);
+            __atomic_store_n(&control->tail, tail + c, __ATOMIC_RELEASE);
+            done += c;
+        }
+        return done;
+    }
+
+    // For mapped rings: blocks until at least `bytes` are free
+    bool waitForSpace(uint32_t bytes)
+    {
+        return waitForRoom(bytes > BYTES ? BYTES : bytes);
+    }
+
+    // Takes up to `frames` whole frames without blocking, returns how many
+    uint32_t read(int16_t *out, uint32_t frames)
+    {
+        uint32_t avail = used() / 4;
+        if (avail > frames)
+        {
+            avail = frames;
+        }
+        uint32_t c = avail * 4;
+        uint32_t head = control->head;
+        uint32_t at = head & (BYTES - 1);
+        uint32_t first = (BYTES - at) < c ? (BYTES - at) : c;
+        memcpy(out, data + at, first);
+        memcpy((uint8_t *)out + first, data, c - first);
+        __atomic_store_n(&control->head, head + c, __ATOMIC_RELEASE);
+
+        if (c > 0 && __atomic_exchange_n(&writerWaiting, false, __ATOMIC_SEQ_CST))
+        {
+            space.up();
+        }
+        return avail;
+    }
+
+    void underrun() { control->underruns = control->underruns + 1; }
+
+    // No more writes are coming
+    void close()
+    {
+        __atomic_store_n(&closed, true, __ATOMIC_RELEASE);
+    }
+
+    bool isClosed()
+    {
+        return __atomic_load_n(&closed, __ATOMIC_ACQUIRE);
+    }
+
+    // The mixer took a stream on this ring
+    void attach()
+    {
+        __atomic_store_n(&consumerGone, false, __ATOMIC_RELEASE);
+    }
+
+    // The mixer is done with it; releases a producer waiting for room
+    void detach()
+    {
+        __atomic_store_n(&consumerGone, true, __ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&writerWaiting, false, __ATOMIC_SEQ_CST))
+        {
+            space.up();
+        }
+    }
+
+    friend class Shared<AudioRing>;
+};
+
+#endif
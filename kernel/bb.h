@@ -58,7 +58,7 @@ namespace gheith
         Work work;
         Shared<BoundedBuffer<Out>> buffer;
 
-        StreamImpl(uint32_t N, Work work) : TCBWithStack(), work(work), buffer(Shared<BoundedBuffer<Out>>::make(N))
+        StreamImpl(Shared<Process> process, uint32_t N, Work work) : TCBWithStack(process), work(work), buffer(Shared<BoundedBuffer<Out>>::make(N))
         {
         }
 
@@ -74,14 +74,16 @@ namespace gheith
 
 }
 
+// Runs work(buffer) in a new thread of `process`; whatever it puts in the
+// buffer (at most N at a time) comes out of the returned end
 template <typename Out, typename Work>
-Shared<BoundedBuffer<Out>> stream(uint32_t N, Work work)
+Shared<BoundedBuffer<Out>> stream(Shared<Process> process, uint32_t N, Work work)
 {
     using namespace gheith;
 
     delete_zombies();
 
-    auto tcb = new StreamImpl<Out, Work>(N, work);
+    auto tcb = new StreamImpl<Out, Work>(process, N, work);
     auto b = tcb->buffer;
     schedule(tcb);
     return b;
@@ -0,0 +1,275 @@
+#include "bench.h"
+#include "debug.h"
+#include "machine.h"
+#include "pit.h"
+#include "resample.h"
+#include "pcm.h"
+#include "adpcm.h"
+#include "flac.h"
+#include "dsp.h"
+
+namespace AudioBench {
+
+    constexpr uint32_t BLOCK_FRAMES = 2048;
+    constexpr uint32_t WINDOW_JIFFIES = 250;
+
+    static uint32_t now() {
+        return __atomic_load_n(&Pit::jiffies, __ATOMIC_SEQ_CST);
+    }
+
+    // Calls work() (which handles `frames` output frames) for about
+    // WINDOW_JIFFIES ms and reports the sustained rate
+    template <typename Work>
+    static void measure(const char* name, uint32_t frames, Work work) {
+        uint32_t start = now();
+        while (now() == start) pause();
+        start = now();
+
+        uint32_t done = 0;
+        uint32_t t0 = (uint32_t) rdtsc();
+        uint32_t elapsed;
+        do {
+            work();
+            done += frames;
+            elapsed = now() - start;
+        } while (elapsed < WINDOW_JIFFIES);
+        uint32_t cycles = (uint32_t) rdtsc() - t0;
+
+        uint32_t perSecond = (done / elapsed) * 1000 + ((done % elapsed) * 1000) / elapsed;
+        Debug::printf("| bench %s: %u frames/s (%u samples/s), %u cycles/frame\n",
+            name, perSecond, perSecond * 2, cycles / done);
+    }
+
+    // A full-scale triangle wave, so the interpolator sees real slopes
+    static int16_t* makeInput(uint32_t frames) {
+        auto in = new int16_t[frames * 2];
+        int32_t v = 0;
+        int32_t dv = 737;
+        for (uint32_t i = 0; i < frames; i++) {
+            v += dv;
+            if (v > 32000 || v < -32000) dv = -dv;
+            in[2 * i] = (int16_t) v;
+            in[2 * i + 1] = (int16_t) -v;
+        }
+        return in;
+    }
+
+    static void resampler(uint32_t inRate, uint32_t outRate, const char* name) {
+        auto in = makeInput(BLOCK_FRAMES);
+        auto out = new int16_t[BLOCK_FRAMES * 2];
+        auto rs = new Resampler(inRate, outRate);
+
+        auto pull = [in](int16_t* buf, uint32_t n) {
+            if (n > BLOCK_FRAMES) n = BLOCK_FRAMES;
+            memcpy(buf, in, n * 4);
+            return n;
+        };
+        measure(name, BLOCK_FRAMES, [rs, out, &pull] {
+            rs->run(out, BLOCK_FRAMES, pull);
+        });
+
+        delete rs;
+        delete[] out;
+        delete[] in;
+    }
+
+    static void convert(uint16_t encoding, uint16_t channels, uint16_t bits, const char* name) {
+        PCM::Format format;
+        PCM::describe(encoding, channels, bits, channels * (bits / 8), format);
+        // contents don't matter, every path is branch free per sample
+        auto in = (uint32_t*) makeInput(BLOCK_FRAMES * 4);
+        auto out = new int16_t[BLOCK_FRAMES * 2];
+
+        measure(name, BLOCK_FRAMES, [&format, in, out] {
+            PCM::toStereo16(format, in, out, BLOCK_FRAMES);
+        });
+
+        delete[] out;
+        delete[] (int16_t*) in;
+    }
+
+    // Blocks of arbitrary nibbles behind a valid header, decoded over and over
+    static void adpcm(uint16_t formatTag, const char* name) {
+        auto decoder = AdpcmDecoder::make(formatTag, 2, 2048, nullptr, 0);
+        auto block = new uint8_t[2048];
+        for (uint32_t i = 0; i < 2048; i++) block[i] = (uint8_t) (i * 37 + 11);
+        block[0] = block[1] = 0;
+        auto out = new int16_t[decoder->framesPerBlock * 2];
+
+        measure(name, decoder->framesPerBlock, [decoder, block, out] {
+            decoder->decode(block, 2048, out);
+        });
+
+        delete[] out;
+        delete[] block;
+        delete decoder;
+    }
+
+    // Just enough of a FLAC encoder to give the decoder realistic input:
+    // 16-bit stereo, fixed order 2 prediction, one Rice partition per subframe
+    class BitWriter {
+        uint8_t* out;
+        uint32_t acc = 0;
+        uint32_t bits = 0;
+    public:
+        uint32_t length = 0;
+
+        BitWriter(uint8_t* out) : out(out) {}
+
+        void write(uint32_t v, uint32_t n) {
+            for (uint32_t i = n; i > 0; i--) {
+                acc = (acc << 1) | ((v >> (i - 1)) & 1);
+                if (++bits == 8) {
+                    out[length++] = (uint8_t) acc;
+                    acc = 0;
+                    bits = 0;
+                }
+            }
+        }
+
+        void align() {
+            if (bits != 0) write(0, 8 - bits);
+        }
+    };
+
+    constexpr uint32_t FLAC_BLOCK = 4096;
+    constexpr uint32_t FLAC_FRAMES = 4;
+
+    static uint32_t makeFlac(uint8_t* buf) {
+        BitWriter w{buf};
+        w.write(0x664C6143, 32);            // "fLaC"
+        w.write(1, 1);                      // last metadata block
+        w.write(0, 7);                      // STREAMINFO
+        w.write(34, 24);
+        w.write(FLAC_BLOCK, 16);
+        w.write(FLAC_BLOCK, 16);
+        w.write(0, 24);
+        w.write(0, 24);
+        w.write(48000, 20);
+        w.write(2 - 1, 3);
+        w.write(16 - 1, 5);
+        w.write(0, 4);                      // sample count, top
+        for (uint32_t i = 0; i < 4 + 16; i++) w.write(0, 8);
+
+        // triangle plus noise, so residuals aren't trivially small
+        auto pcm = makeInput(FLAC_BLOCK);
+        auto residual = new int32_t[FLAC_BLOCK];
+        uint32_t seed = 12345;
+
+        for (uint32_t f = 0; f < FLAC_FRAMES; f++) {
+            w.write(0x3FFE, 14);
+            w.write(0, 2);
+            w.write(12, 4);                 // 256 << 4 = 4096
+            w.write(0, 4);                  // rate from STREAMINFO
+            w.write(1, 4);                  // independent stereo
+            w.write(4, 3);                  // 16 bits
+            w.write(0, 1);
+            w.write(f, 8);                  // frame number
+            w.write(0, 8);                  // CRC-8, not checked
+
+            for (uint32_t c = 0; c < 2; c++) {
+                int32_t s[3] = {0, 0, 0};
+                uint32_t sum = 0;
+                for (uint32_t i = 0; i < FLAC_BLOCK; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    int32_t v = pcm[2 * i + c] / 2 + (int32_t) ((seed >> 16) & 0x1FF) - 256;
+                    s[2] = s[1];
+                    s[1] = s[0];
+                    s[0] = v;
+                    residual[i] = v - (2 * s[1] - s[2]);
+                    if (i < 2) residual[i] = v;
+                    else sum += residual[i] < 0 ? -residual[i] : residual[i];
+                }
+                uint32_t mean = sum / FLAC_BLOCK;
+                uint32_t k = 0;
+                while ((2u << k) <= mean && k < 14) k++;
+
+                w.write(0, 1);
+                w.write(8 + 2, 6);          // fixed, order 2
+                w.write(0, 1);
+                w.write((uint32_t) residual[0] & 0xFFFF, 16);
+                w.write((uint32_t) residual[1] & 0xFFFF, 16);
+                w.write(0, 2);              // Rice, 4-bit parameter
+                w.write(0, 4);              // one partition
+                w.write(k, 4);
+                for (uint32_t i = 2; i < FLAC_BLOCK; i++) {
+                    int32_t r = residual[i];
+                    uint32_t u = r >= 0 ? (uint32_t) r << 1 : ((uint32_t) -r << 1) - 1;
+                    for (uint32_t q = u >> k; q > 0; q--) w.write(0, 1);
+                    w.write(1, 1);
+                    w.write(u, k);
+                }
+            }
+            w.align();
+            w.write(0, 16);                 // CRC-16, not checked
+        }
+
+        delete[] residual;
+        delete[] pcm;
+        return w.length;
+    }
+
+    static void flac() {
+        auto data = new uint8_t[FLAC_FRAMES * FLAC_BLOCK * 8];
+        uint32_t length = makeFlac(data);
+        auto out = new int16_t[FLAC_BLOCK * 2];
+
+        measure("decode flac stereo 16-bit", FLAC_FRAMES * FLAC_BLOCK, [data, length, out] {
+            FlacDecoder decoder{data, length};
+            if (!decoder.open()) return;
+            uint32_t n;
+            while ((n = decoder.nextFrame()) != 0) {
+                decoder.output(out, 0, n);
+            }
+        });
+
+        delete[] out;
+        delete[] data;
+    }
+
+    // A mild low shelf-ish filter, about what an EQ band looks like in Q14
+    static constexpr Dsp::Biquad BAND{16800, -31900, 15300, -31900, 15700};
+
+    static void dsp(uint32_t biquads, uint32_t limit, bool ramp, const char* name) {
+        Dsp::Config config{};
+        config.rampFrames = BLOCK_FRAMES;
+        config.biquads = biquads;
+        for (uint32_t i = 0; i < biquads; i++) config.filters[i] = BAND;
+        config.limit = limit;
+        config.releaseFrames = BLOCK_FRAMES;
+        auto chain = new Dsp(config);
+        auto in = makeInput(BLOCK_FRAMES);
+        auto buf = new int16_t[BLOCK_FRAMES * 2];
+
+        // flipping the target every block keeps the gain ramping all the time
+        uint32_t target = 0x6000;
+        measure(name, BLOCK_FRAMES, [chain, in, buf, ramp, &target] {
+            memcpy(buf, in, BLOCK_FRAMES * 4);
+            if (ramp) target ^= 0x6000 ^ 0x4000;
+            chain->run(buf, BLOCK_FRAMES, target);
+        });
+
+        delete[] buf;
+        delete[] in;
+        delete chain;
+    }
+
+    void run() {
+        Debug::printf("| audio benchmarks, %u ms per test\n", WINDOW_JIFFIES);
+        resampler(44100, 48000, "resample 44100->48000");
+        resampler(22050, 48000, "resample 22050->48000");
+        resampler(48000, 44100, "resample 48000->44100");
+        convert(PCM::WAVE_FORMAT_PCM, 1, 8, "convert u8 mono");
+        convert(PCM::WAVE_FORMAT_PCM, 1, 16, "convert s16 mono");
+        convert(PCM::WAVE_FORMAT_PCM, 2, 24, "convert s24 stereo");
+        convert(PCM::WAVE_FORMAT_PCM, 2, 32, "convert s32 stereo");
+        convert(PCM::WAVE_FORMAT_IEEE_FLOAT, 2, 32, "convert float stereo");
+        adpcm(AdpcmDecoder::WAVE_FORMAT_IMA_ADPCM, "decode ima adpcm stereo");
+        adpcm(AdpcmDecoder::WAVE_FORMAT_ADPCM, "decode ms adpcm stereo");
+        flac();
+        dsp(0, 0, true, "dsp gain ramp");
+        dsp(4, 0, false, "dsp gain + 4 biquads");
+        dsp(0, 0x4000, false, "dsp gain + limiter (limiting)");
+        dsp(4, 0x4000, true, "dsp all stages");
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+// Throughput benchmarks for the audio pipeline. Built into every kernel
+// but only run when compiled with -DAUDIO_BENCH, e.g.
+//
+//     UTCS_OPT="-O3 -DAUDIO_BENCH" make -s t0.test
+//
+// Results go to the serial log (t0.raw) as "| bench ..." lines.
+namespace AudioBench {
+    extern void run();
+}
+
+#endif
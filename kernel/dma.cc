@@ -0,0 +1,71 @@
+#include "dma.h"
+#include "blocking_lock.h"
+#include "debug.h"
+#include "machine.h"
+
+namespace DMA {
+
+    static InterruptSafeLock lock{};
+
+    static uint32_t base;
+    static uint32_t granules;
+
+    // one bit per granule, set while allocated
+    static uint32_t* used = nullptr;
+
+    static inline bool isUsed(uint32_t g) {
+        return (used[g / 32] >> (g % 32)) & 1;
+    }
+
+    static inline void mark(uint32_t first, uint32_t n, bool v) {
+        for (uint32_t g = first; g < first + n; g++) {
+            if (v) {
+                used[g / 32] |= 1u << (g % 32);
+            } else {
+                used[g / 32] &= ~(1u << (g % 32));
+            }
+        }
+    }
+
+    void init(uint32_t start, uint32_t size) {
+        ASSERT(start % GRANULE == 0);
+        base = start;
+        granules = size / GRANULE;
+        used = new uint32_t[(granules + 31) / 32];
+        bzero(used, ((granules + 31) / 32) * 4);
+        Debug::printf("| DMA pool 0x%x 0x%x\n", start, start + granules * GRANULE);
+    }
+
+    Region alloc(uint32_t bytes, uint32_t align) {
+        Region r{};
+        if (bytes == 0) return r;
+        if (align < GRANULE) align = GRANULE;
+
+        uint32_t n = (bytes + GRANULE - 1) / GRANULE;
+        uint32_t step = align / GRANULE;
+
+        LockGuard g{lock};
+
+        // first fit over candidate starts that satisfy the alignment
+        uint32_t first = ((base + align - 1) & ~(align - 1)) - base;
+        for (uint32_t s = first / GRANULE; s + n <= granules; s += step) {
+            uint32_t k = 0;
+            while (k < n && !isUsed(s + k)) k++;
+            if (k == n) {
+                mark(s, n, true);
+                r.pa = base + s * GRANULE;
+                r.bytes = n * GRANULE;
+                bzero(r.virt<void>(), r.bytes);
+                return r;
+            }
+        }
+        return r;
+    }
+
+    void free(Region region) {
+        if (region.isNull()) return;
+        ASSERT(region.pa >= base && region.pa < base + granules * GRANULE);
+        LockGuard g{lock};
+        mark((region.pa - base) / GRANULE, region.bytes / GRANULE, false);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _DMA_H_
+#define _DMA_H_
+
+#include "stdint.h"
+
+// Memory for devices to read and write on their own (bus master DMA).
+//
+// The pool is a physically contiguous range taken from PhysMem at boot,
+// separate from the kernel heap. Every region handed out is contiguous,
+// zeroed and aligned to at least GRANULE bytes. Kernel memory is identity
+// mapped so the virtual and physical addresses of a region are the same
+// number, but callers should still go through virt()/phys() to say which
+// one they mean.
+namespace DMA {
+    constexpr uint32_t GRANULE = 128;
+
+    struct Region {
+        uint32_t pa = 0;
+        uint32_t bytes = 0;
+
+        bool isNull() const {
+            return bytes == 0;
+        }
+
+        template <typename T>
+        T* virt() const {
+            return (T*) pa;
+        }
+
+        uint32_t phys() const {
+            return pa;
+        }
+    };
+
+    inline void* virt(uint32_t pa) {
+        return (void*) pa;
+    }
+
+    inline uint32_t phys(const void* va) {
+        return (uint32_t) va;
+    }
+
+    void init(uint32_t start, uint32_t size);
+
+    // `align` is a power of two, regions are never less aligned than
+    // GRANULE. Returns a null region if the pool can't satisfy it.
+    Region alloc(uint32_t bytes, uint32_t align = GRANULE);
+
+    void free(Region region);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "dsp.h"
+
+// Frames are handled as one 32-bit word each, left in the low half: one
+// load and one store per frame, and where it pays (the limiter's peak
+// scan) both channels are worked on at once (SWAR). The kernel is built
+// without SSE so there are no wider registers to use.
+
+constexpr static int32_t MAX_COEFFICIENT = 4 << 14;
+
+static inline int32_t left(uint32_t frame)
+{
+    return (int16_t)frame;
+}
+
+static inline int32_t right(uint32_t frame)
+{
+    return (int32_t)frame >> 16;
+}
+
+static inline int32_t saturate(int32_t v)
+{
+    if (v > 32767)
+        return 32767;
+    if (v < -32768)
+        return -32768;
+    return v;
+}
+
+static inline uint32_t pack(int32_t l, int32_t r)
+{
+    return (uint16_t)saturate(l) | ((uint32_t)saturate(r) << 16);
+}
+
+static inline int32_t clampCoefficient(int32_t c)
+{
+    if (c > MAX_COEFFICIENT)
+        return MAX_COEFFICIENT;
+    if (c < -MAX_COEFFICIENT)
+        return -MAX_COEFFICIENT;
+    return c;
+}
+
+// Upper bound on |sample| over n frames, both channels at a time. Each
+// half is made positive with its own sign mask, then everything is ORed
+// together: never below the real peak, less than twice it.
+static uint32_t peakBound(const uint32_t *frames, uint32_t n)
+{
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t x = frames[i];
+        uint32_t signs = (x >> 15) & 0x00010001;
+        uint32_t mask = signs * 0xFFFF;
+        // ~x + 1 in the negative halves; the low one can't carry out
+        acc |= (x ^ mask) + signs;
+    }
+    uint32_t lo = acc & 0xFFFF;
+    uint32_t hi = acc >> 16;
+    return lo > hi ? lo : hi;
+}
+
+Dsp::Dsp(const Config &c) : config(c)
+{
+    if (config.biquads > MAX_BIQUADS)
+    {
+        config.biquads = MAX_BIQUADS;
+    }
+    if (config.limit >= (uint32_t)UNITY)
+    {
+        config.limit = 0;
+    }
+    // Q14 up to +-4 is plenty for an EQ, and keeps the sums in range
+    for (uint32_t i = 0; i < config.biquads; i++)
+    {
+        Biquad &q = config.filters[i];
+        q.b0 = clampCoefficient(q.b0);
+        q.b1 = clampCoefficient(q.b1);
+        q.b2 = clampCoefficient(q.b2);
+        q.a1 = clampCoefficient(q.a1);
+        q.a2 = clampCoefficient(q.a2);
+    }
+    if (config.rampFrames > MAX_RAMP_FRAMES)
+    {
+        config.rampFrames = MAX_RAMP_FRAMES;
+    }
+    release = UNITY / (config.releaseFrames == 0 ? 1 : config.releaseFrames);
+    if (release == 0)
+    {
+        release = 1;
+    }
+}
+
+void Dsp::run(int16_t *samples, uint32_t n, uint32_t want)
+{
+    auto frames = (uint32_t *)samples;
+    if ((int32_t)want != target)
+    {
+        target = want;
+        rampLeft = config.rampFrames;
+        if (rampLeft == 0)
+        {
+            gain = target;
+        }
+        else
+        {
+            // the division drops under one Q15.16 unit per frame, so the
+            // last frame jumps by less than MAX_RAMP_FRAMES >> 16
+            fine = (uint32_t)gain << 16;
+            if (target >= gain)
+                step = ((uint32_t)(target - gain) << 16) / rampLeft;
+            else
+                step = -(((uint32_t)(gain - target) << 16) / rampLeft);
+        }
+    }
+    applyGain(frames, n);
+    for (uint32_t i = 0; i < config.biquads; i++)
+    {
+        filter(i, frames, n);
+    }
+    if (config.limit != 0)
+    {
+        limit(frames, n);
+    }
+}
+
+void Dsp::applyGain(uint32_t *frames, uint32_t n)
+{
+    uint32_t i = 0;
+    while (rampLeft > 0 && i < n)
+    {
+        fine += step;
+        gain = (int32_t)(fine >> 16);
+        if (--rampLeft == 0)
+        {
+            gain = target; // whatever the division dropped
+        }
+        uint32_t f = frames[i];
+        frames[i++] = pack((left(f) * gain) >> 15, (right(f) * gain) >> 15);
+    }
+    if (gain == UNITY)
+    {
+        return;
+    }
+    int32_t g = gain;
+    for (; i < n; i++)
+    {
+        uint32_t f = frames[i];
+        frames[i] = pack((left(f) * g) >> 15, (right(f) * g) >> 15);
+    }
+}
+
+void Dsp::filter(uint32_t k, uint32_t *frames, uint32_t n)
+{
+    const Biquad &q = config.filters[k];
+    int32_t *sl = state[k][0];
+    int32_t *sr = state[k][1];
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t f = frames[i];
+        int32_t xl = left(f);
+        int32_t xr = right(f);
+
+        // five products each, too many for 32 bits
+        int64_t al = (int64_t)q.b0 * xl + (int64_t)q.b1 * sl[0] + (int64_t)q.b2 * sl[1] - (int64_t)q.a1 * sl[2] - (int64_t)q.a2 * sl[3];
+        int64_t ar = (int64_t)q.b0 * xr + (int64_t)q.b1 * sr[0] + (int64_t)q.b2 * sr[1] - (int64_t)q.a1 * sr[2] - (int64_t)q.a2 * sr[3];
+        int32_t yl = saturate((int32_t)(al >> 14));
+        int32_t yr = saturate((int32_t)(ar >> 14));
+
+        sl[1] = sl[0];
+        sl[0] = xl;
+        sl[3] = sl[2];
+        sl[2] = yl;
+        sr[1] = sr[0];
+        sr[0] = xr;
+        sr[3] = sr[2];
+        sr[2] = yr;
+        frames[i] = pack(yl, yr);
+    }
+}
+
+void Dsp::limit(uint32_t *frames, uint32_t n)
+{
+    int32_t lim = config.limit;
+    // fully released and nothing gets near the limit: the usual case
+    if (envelope == UNITY && peakBound(frames, n) <= (uint32_t)lim)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t f = frames[i];
+        int32_t l = left(f);
+        int32_t r = right(f);
+        int32_t al = l < 0 ? -l : l;
+        int32_t ar = r < 0 ? -r : r;
+        int32_t peak = al > ar ? al : ar;
+        if (((peak * envelope) >> 15) > lim)
+        {
+            envelope = (lim << 15) / peak;
+        }
+        frames[i] = pack((l * envelope) >> 15, (r * envelope) >> 15);
+        envelope += release;
+        if (envelope > UNITY)
+        {
+            envelope = UNITY;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef _DSP_H_
+#define _DSP_H_
+
+#include "stdint.h"
+
+// Per-stream effects, run on a stream's 16-bit stereo frames right after
+// it renders a period and before they are mixed:
+//
+//   - Q15 gain that ramps linearly to a new target instead of jumping
+//   - a cascade of up to MAX_BIQUADS biquad filters (EQ)
+//   - a peak limiter without look-ahead: instant attack, linear release
+//
+// All fixed point. The work per period is linear in frames and bounded by
+// MAX_BIQUADS, and a stage that has nothing to do (gain at unity, no
+// filters, signal under the limit) costs one check per period.
+class Dsp
+{
+public:
+    constexpr static uint32_t MAX_BIQUADS = 4;
+    constexpr static uint32_t MAX_RAMP_FRAMES = 1 << 20; // about 20s
+    constexpr static int32_t UNITY = 0x8000;
+
+    // y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2], coefficients Q14
+    struct Biquad
+    {
+        int32_t b0, b1, b2, a1, a2;
+    };
+
+    // matches struct audio_dsp in user space
+    struct Config
+    {
+        uint32_t rampFrames;    // gain changes take this long, 0 -> immediate
+        uint32_t biquads;       // how many of filters are used
+        Biquad filters[MAX_BIQUADS];
+        uint32_t limit;         // peak allowed out of the limiter, 0 or >= 0x8000 -> off
+        uint32_t releaseFrames; // limiter gain takes this long to get back to unity
+    };
+
+    // out of range fields are clamped
+    Dsp(const Config &config);
+
+    // Processes frames in place. `target` is the Q15 gain the stream
+    // should be at (0 .. 0xFFFF); a change starts a new ramp.
+    void run(int16_t *samples, uint32_t frames, uint32_t target);
+
+private:
+    Config config;
+
+    int32_t gain = UNITY;   // where the ramp is
+    int32_t target = UNITY; // where it's going
+    // The ramp moves in Q15.16 so that ramps longer than the change still
+    // move smoothly. Gains fit in 16 bits, so this fits in 32; steps down
+    // are added as their two's complement and wrap.
+    uint32_t fine = 0;
+    uint32_t step = 0;
+    uint32_t rampLeft = 0;
+
+    // x[-1], x[-2], y[-1], y[-2] for each filter and channel
+    int32_t state[MAX_BIQUADS][2][4]{};
+
+    int32_t envelope = UNITY; // limiter gain, Q15
+    int32_t release = 0;      // added to the envelope every frame
+
+    void applyGain(uint32_t *frames, uint32_t n);
+    void filter(uint32_t i, uint32_t *frames, uint32_t n);
+    void limit(uint32_t *frames, uint32_t n);
+};
+
+#endif
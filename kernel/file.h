@@ -18,6 +18,11 @@ public:
     virtual ssize_t read(void* buf, size_t size) = 0;
     virtual ssize_t write(void* buf, size_t size) = 0;
     virtual off_t getOffset();
+    // i-number of the node behind this file, 0 if there isn't one
+    virtual uint32_t inumber() { return 0; }
+    // A new handle on the same file at the same offset, with an offset of
+    // its own from then on. Null if the file can't do that.
+    virtual Shared<File> reopen() { return Shared<File>{}; }
     friend class Shared<File>;
 };
 
@@ -0,0 +1,483 @@
+#include "flac.h"
+
+BitReader::BitReader(Shared<File> file) : file(file)
+{
+    buffer = new uint8_t[BUFFER_BYTES];
+    data = buffer;
+}
+
+BitReader::~BitReader()
+{
+    delete[] buffer;
+}
+
+bool BitReader::fill()
+{
+    if (file == nullptr)
+    {
+        return false;
+    }
+    auto cnt = file->read(buffer, BUFFER_BYTES);
+    if (cnt <= 0)
+    {
+        return false;
+    }
+    length = cnt;
+    pos = 0;
+    return true;
+}
+
+void BitReader::skip(uint32_t n)
+{
+    while (n > 0 && count > 0)
+    {
+        read(8);
+        n--;
+    }
+    uint32_t here = length - pos;
+    if (n <= here)
+    {
+        pos += n;
+        return;
+    }
+    n -= here;
+    pos = length;
+    if (file != nullptr)
+    {
+        file->seek(file->getOffset() + n);
+    }
+    else
+    {
+        overrun = true;
+    }
+}
+
+FlacDecoder::FlacDecoder(Shared<File> file) : in(file)
+{
+    samples[0] = samples[1] = samples[2] = nullptr;
+}
+
+FlacDecoder::FlacDecoder(const uint8_t *data, uint32_t length) : in(data, length)
+{
+    samples[0] = samples[1] = samples[2] = nullptr;
+}
+
+FlacDecoder::~FlacDecoder()
+{
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        delete[] samples[i];
+    }
+}
+
+bool FlacDecoder::readStreamInfo()
+{
+    in.read(16); // min block size
+    maxBlock = in.read(16);
+    in.read(24); // min frame size
+    maxFrameBytes = in.read(24);
+    sampleRate = in.read(20);
+    channels = in.read(3) + 1;
+    bitsPerSample = in.read(5) + 1;
+    uint32_t high = in.read(4); // sample count, top bits
+    uint32_t low = in.read(32);
+    totalFrames = high == 0 ? low : 0;
+    in.skip(16);                // the MD5
+    return !in.overrun;
+}
+
+bool FlacDecoder::open()
+{
+    if (in.read(32) != 0x664C6143) // "fLaC"
+    {
+        return false;
+    }
+
+    bool haveInfo = false;
+    for (;;)
+    {
+        uint32_t last = in.read(1);
+        uint32_t type = in.read(7);
+        uint32_t length = in.read(24);
+        if (in.overrun)
+        {
+            return false;
+        }
+        if (type == 0 && length == 34)
+        {
+            haveInfo = readStreamInfo();
+        }
+        else
+        {
+            in.skip(length);
+        }
+        if (last)
+        {
+            break;
+        }
+    }
+
+    if (!haveInfo || maxBlock < MIN_BLOCK || maxBlock > MAX_BLOCK || bitsPerSample < 4 || bitsPerSample > 24 || sampleRate == 0)
+    {
+        return false;
+    }
+    if (maxFrameBytes == 0)
+    {
+        // unknown: verbatim subframes, a side channel one bit wider, headers and padding
+        maxFrameBytes = maxBlock * channels * (bitsPerSample + 1) / 8 + 64;
+    }
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        samples[i] = new int32_t[maxBlock];
+    }
+    return true;
+}
+
+bool FlacDecoder::readFrameHeader(uint32_t &channelAssignment, uint32_t &bits)
+{
+    if (in.read(15) != 0x7FFC) // sync code and a reserved zero
+    {
+        return false;
+    }
+    in.read(1); // fixed or variable block size, we don't care
+    uint32_t blockCode = in.read(4);
+    uint32_t rateCode = in.read(4);
+    channelAssignment = in.read(4);
+    uint32_t sizeCode = in.read(3);
+    in.read(1);
+
+    // frame or sample number, UTF-8 style
+    uint32_t first = in.read(8);
+    uint32_t extra = 0;
+    while (extra < 7 && (first & (0x80 >> extra)))
+    {
+        extra++;
+    }
+    for (uint32_t i = 1; i < extra; i++)
+    {
+        in.read(8);
+    }
+
+    if (blockCode == 0)
+    {
+        return false;
+    }
+    else if (blockCode == 1)
+    {
+        blockSize = 192;
+    }
+    else if (blockCode <= 5)
+    {
+        blockSize = 576 << (blockCode - 2);
+    }
+    else if (blockCode == 6)
+    {
+        blockSize = in.read(8) + 1;
+    }
+    else if (blockCode == 7)
+    {
+        blockSize = in.read(16) + 1;
+    }
+    else
+    {
+        blockSize = 256 << (blockCode - 8);
+    }
+
+    // the stream rate is what we play at, just step over an explicit one
+    if (rateCode == 12)
+    {
+        in.read(8);
+    }
+    else if (rateCode == 13 || rateCode == 14)
+    {
+        in.read(16);
+    }
+    else if (rateCode == 15)
+    {
+        return false;
+    }
+
+    static const uint8_t sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+    bits = (sizeCode == 0) ? bitsPerSample : sizes[sizeCode];
+
+    in.read(8); // CRC-8
+
+    return !in.overrun && bits != 0 && bits <= 24 && blockSize <= maxBlock && channelAssignment <= 10;
+}
+
+bool FlacDecoder::readResidual(int32_t *out, uint32_t order)
+{
+    uint32_t method = in.read(2);
+    if (method > 1)
+    {
+        return false;
+    }
+    uint32_t paramBits = method == 0 ? 4 : 5;
+    uint32_t escape = method == 0 ? 15 : 31;
+    uint32_t partitionOrder = in.read(4);
+    uint32_t partitions = 1 << partitionOrder;
+    uint32_t perPartition = blockSize >> partitionOrder;
+    if ((perPartition << partitionOrder) != blockSize || perPartition < order)
+    {
+        return false;
+    }
+
+    uint32_t i = order;
+    for (uint32_t p = 0; p < partitions; p++)
+    {
+        uint32_t end = (p + 1) * perPartition;
+        uint32_t k = in.read(paramBits);
+        if (k == escape)
+        {
+            uint32_t n = in.read(5);
+            for (; i < end; i++)
+            {
+                out[i] = in.readSigned(n);
+            }
+        }
+        else
+        {
+            for (; i < end; i++)
+            {
+                out[i] = in.readRice(k);
+            }
+        }
+    }
+    return !in.overrun;
+}
+
+bool FlacDecoder::readSubframe(int32_t *out, uint32_t bits)
+{
+    if (in.read(1) != 0)
+    {
+        return false;
+    }
+    uint32_t type = in.read(6);
+    uint32_t wasted = 0;
+    if (in.read(1))
+    {
+        wasted = in.readUnary() + 1;
+        if (wasted >= bits)
+        {
+            return false;
+        }
+        bits -= wasted;
+    }
+
+    if (type == 0)
+    {
+        int32_t v = in.readSigned(bits);
+        for (uint32_t i = 0; i < blockSize; i++)
+        {
+            out[i] = v;
+        }
+    }
+    else if (type == 1)
+    {
+        for (uint32_t i = 0; i < blockSize; i++)
+        {
+            out[i] = in.readSigned(bits);
+        }
+    }
+    else if (type >= 8 && type <= 12)
+    {
+        uint32_t order = type - 8;
+        if (order > blockSize)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < order; i++)
+        {
+            out[i] = in.readSigned(bits);
+        }
+        if (!readResidual(out, order))
+        {
+            return false;
+        }
+        // residual + prediction in place
+        switch (order)
+        {
+        case 1:
+            for (uint32_t i = 1; i < blockSize; i++)
+                out[i] += out[i - 1];
+            break;
+        case 2:
+            for (uint32_t i = 2; i < blockSize; i++)
+                out[i] += 2 * out[i - 1] - out[i - 2];
+            break;
+        case 3:
+            for (uint32_t i = 3; i < blockSize; i++)
+                out[i] += 3 * (out[i - 1] - out[i - 2]) + out[i - 3];
+            break;
+        case 4:
+            for (uint32_t i = 4; i < blockSize; i++)
+                out[i] += 4 * (out[i - 1] + out[i - 3]) - 6 * out[i - 2] - out[i - 4];
+            break;
+        }
+    }
+    else if (type >= 32)
+    {
+        uint32_t order = type - 31;
+        // the warm-up samples go straight into out
+        if (order > blockSize)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < order; i++)
+        {
+            out[i] = in.readSigned(bits);
+        }
+        uint32_t precision = in.read(4) + 1;
+        int32_t shift = in.readSigned(5);
+        if (precision == 16 || shift < 0)
+        {
+            return false;
+        }
+        int32_t coefs[32];
+        for (uint32_t i = 0; i < order; i++)
+        {
+            coefs[i] = in.readSigned(precision);
+        }
+        if (!readResidual(out, order))
+        {
+            return false;
+        }
+
+        // 32-bit sums are exact as long as the products and their sum fit
+        uint32_t orderBits = 32 - __builtin_clz(order);
+        if (bits + precision + orderBits <= 32)
+        {
+            for (uint32_t i = order; i < blockSize; i++)
+            {
+                int32_t sum = 0;
+                for (uint32_t j = 0; j < order; j++)
+                {
+                    sum += coefs[j] * out[i - 1 - j];
+                }
+                out[i] += sum >> shift;
+            }
+        }
+        else
+        {
+            for (uint32_t i = order; i < blockSize; i++)
+            {
+                int64_t sum = 0;
+                for (uint32_t j = 0; j < order; j++)
+                {
+                    sum += (int64_t)coefs[j] * out[i - 1 - j];
+                }
+                out[i] += (int32_t)(sum >> shift);
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    if (wasted)
+    {
+        for (uint32_t i = 0; i < blockSize; i++)
+        {
+            out[i] <<= wasted;
+        }
+    }
+    return true;
+}
+
+uint32_t FlacDecoder::nextFrame()
+{
+    if (ended || in.atEnd())
+    {
+        ended = true;
+        return 0;
+    }
+
+    uint32_t assignment;
+    uint32_t bits;
+    if (!readFrameHeader(assignment, bits))
+    {
+        ended = true;
+        return 0;
+    }
+
+    // 0-7 independent channels, 8-10 a stereo pair where one channel is
+    // the difference of the two and takes an extra bit
+    uint32_t n = assignment < 8 ? assignment + 1 : 2;
+    for (uint32_t c = 0; c < n; c++)
+    {
+        uint32_t b = bits;
+        if ((assignment == 8 || assignment == 10) && c == 1)
+            b++;
+        if (assignment == 9 && c == 0)
+            b++;
+        if (!readSubframe(samples[c < 2 ? c : 2], b))
+        {
+            ended = true;
+            return 0;
+        }
+    }
+
+    int32_t *a = samples[0];
+    int32_t *b = samples[1];
+    switch (assignment)
+    {
+    case 8: // left, side
+        for (uint32_t i = 0; i < blockSize; i++)
+            b[i] = a[i] - b[i];
+        break;
+    case 9: // side, right
+        for (uint32_t i = 0; i < blockSize; i++)
+            a[i] += b[i];
+        break;
+    case 10: // mid, side
+        for (uint32_t i = 0; i < blockSize; i++)
+        {
+            int32_t side = b[i];
+            int32_t mid = (a[i] << 1) | (side & 1);
+            a[i] = (mid + side) >> 1;
+            b[i] = (mid - side) >> 1;
+        }
+        break;
+    case 0: // mono
+        for (uint32_t i = 0; i < blockSize; i++)
+            b[i] = a[i];
+        break;
+    }
+
+    // narrow everything to 16 bits here so output() is a plain interleave
+    if (bits != 16)
+    {
+        for (uint32_t c = 0; c < 2; c++)
+        {
+            int32_t *s = samples[c];
+            if (bits > 16)
+            {
+                uint32_t shift = bits - 16;
+                for (uint32_t i = 0; i < blockSize; i++)
+                    s[i] >>= shift;
+            }
+            else
+            {
+                uint32_t shift = 16 - bits;
+                for (uint32_t i = 0; i < blockSize; i++)
+                    s[i] <<= shift;
+            }
+        }
+    }
+
+    in.alignToByte();
+    in.read(16); // CRC-16
+    return blockSize;
+}
+
+void FlacDecoder::output(int16_t *out, uint32_t from, uint32_t n)
+{
+    const int32_t *l = samples[0] + from;
+    const int32_t *r = samples[1] + from;
+    uint32_t *o = (uint32_t *)out;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        o[i] = ((uint32_t)l[i] & 0xFFFF) | ((uint32_t)r[i] << 16);
+    }
+}
@@ -0,0 +1,192 @@
+#ifndef _FLAC_H_
+#define _FLAC_H_
+
+#include "stdint.h"
+#include "shared.h"
+#include "file.h"
+
+// Big-endian bit reader over either a File (refilled a buffer at a time)
+// or a block of memory.
+class BitReader
+{
+public:
+    constexpr static uint32_t BUFFER_BYTES = 4096;
+
+private:
+    Shared<File> file;
+    uint8_t *buffer = nullptr;
+    const uint8_t *data;
+    uint32_t length = 0; // bytes in data
+    uint32_t pos = 0;    // next byte of data to go into the cache
+
+    // the next `count` bits of the stream, left aligned; bits below them are zero
+    uint32_t cache = 0;
+    uint32_t count = 0;
+
+    bool fill();
+
+    // tops the cache up to at least 25 bits unless the stream ends first
+    inline void refill()
+    {
+        while (count <= 24)
+        {
+            if (pos == length && !fill())
+            {
+                return;
+            }
+            cache |= (uint32_t)data[pos++] << (24 - count);
+            count += 8;
+        }
+    }
+
+public:
+    bool overrun = false; // read past the end, what was returned is zeros
+
+    BitReader(Shared<File> file);
+    BitReader(const uint8_t *data, uint32_t length) : data(data), length(length) {}
+    ~BitReader();
+
+    BitReader(const BitReader &) = delete;
+
+    // n <= 32 bits, unsigned
+    inline uint32_t read(uint32_t n)
+    {
+        if (n > 24)
+        {
+            uint32_t high = read(n - 16);
+            return (high << 16) | read(16);
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (count < n)
+        {
+            refill();
+            if (count < n)
+            {
+                overrun = true;
+                count = n;
+            }
+        }
+        uint32_t v = cache >> (32 - n);
+        cache <<= n;
+        count -= n;
+        return v;
+    }
+
+    // n <= 32 bits, two's complement
+    inline int32_t readSigned(uint32_t n)
+    {
+        if (n == 0)
+        {
+            return 0;
+        }
+        uint32_t v = read(n);
+        return (int32_t)(v << (32 - n)) >> (32 - n);
+    }
+
+    // zeros up to the next one, which is consumed too
+    inline uint32_t readUnary()
+    {
+        uint32_t zeros = 0;
+        for (;;)
+        {
+            if (cache != 0)
+            {
+                uint32_t lz = __builtin_clz(cache);
+                if (lz < count)
+                {
+                    cache = (cache << lz) << 1; // lz + 1 can be 32
+                    count -= lz + 1;
+                    return zeros + lz;
+                }
+            }
+            zeros += count;
+            cache = 0;
+            count = 0;
+            refill();
+            if (count == 0)
+            {
+                overrun = true;
+                return zeros;
+            }
+        }
+    }
+
+    // a Rice coded residual with parameter k, zigzag decoded
+    inline int32_t readRice(uint32_t k)
+    {
+        uint32_t u = (readUnary() << k) | read(k);
+        return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    }
+
+    inline void alignToByte()
+    {
+        uint32_t drop = count & 7;
+        cache <<= drop;
+        count -= drop;
+    }
+
+    // skips n bytes, must be byte aligned
+    void skip(uint32_t n);
+
+    bool atEnd()
+    {
+        refill();
+        return count == 0;
+    }
+};
+
+// Streaming FLAC decoder: STREAMINFO, then frame by frame with constant,
+// verbatim, fixed and LPC subframes and Rice coded residuals. Frame CRCs
+// aren't checked; a frame that doesn't parse ends the stream.
+class FlacDecoder
+{
+public:
+    constexpr static uint32_t MIN_BLOCK = 16; // what the spec allows
+    constexpr static uint32_t MAX_BLOCK = 16384;
+
+private:
+    BitReader in;
+    int32_t *samples[3]; // left, right, and scratch for channels we drop
+    uint32_t blockSize = 0;
+    bool ended = false;
+
+    bool readStreamInfo();
+    bool readFrameHeader(uint32_t &channelAssignment, uint32_t &bits);
+    bool readSubframe(int32_t *out, uint32_t bits);
+    bool readResidual(int32_t *out, uint32_t order);
+
+public:
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    uint32_t bitsPerSample = 0;
+    uint32_t maxBlock = 0;
+    uint32_t totalFrames = 0; // from STREAMINFO, 0 if it doesn't say (or won't fit)
+    uint32_t maxFrameBytes = 0; // from STREAMINFO, or the most a verbatim frame can take
+
+    FlacDecoder(Shared<File> file);
+    FlacDecoder(const uint8_t *data, uint32_t length);
+    ~FlacDecoder();
+
+    FlacDecoder(const FlacDecoder &) = delete;
+
+    // Reads the stream marker and metadata, false if this isn't a FLAC
+    // stream we can play (more than 16384 frames per block, or 32 bits)
+    bool open();
+
+    // Decodes the next frame, returns its length in frames, 0 at the end
+    uint32_t nextFrame();
+
+    // The most nextFrame() can read from the file
+    uint32_t readAhead()
+    {
+        return maxFrameBytes + BitReader::BUFFER_BYTES;
+    }
+
+    // Frames [from, from + n) of the current frame as 16-bit stereo
+    void output(int16_t *out, uint32_t from, uint32_t n);
+};
+
+#endif
@@ -0,0 +1,598 @@
+#include "hda.h"
+#include "debug.h"
+#include "machine.h"
+#include "idt.h"
+#include "ioapic.h"
+#include "smp.h"
+#include "physmem.h"
+#include "semaphore.h"
+#include "dma.h"
+#include "vmm.h"
+#include "pci.h"
+
+#define HDA_CLASS 0x0403 // multimedia, HD audio (class << 8 | subclass)
+
+/* Where we want the HDA controller to interrupt us */
+constexpr uint32_t HDA_vector = 42;
+
+namespace HDA
+{
+    // Controller registers
+    constexpr uint32_t GCAP = 0x00;      // 16: stream counts
+    constexpr uint32_t GCTL = 0x08;      // 32
+    constexpr uint32_t STATESTS = 0x0E;  // 16: codecs that answered the reset
+    constexpr uint32_t INTCTL = 0x20;    // 32
+    constexpr uint32_t INTSTS = 0x24;    // 32
+    constexpr uint32_t CORBLBASE = 0x40; // 32
+    constexpr uint32_t CORBUBASE = 0x44; // 32
+    constexpr uint32_t CORBWP = 0x48;    // 16
+    constexpr uint32_t CORBRP = 0x4A;    // 16
+    constexpr uint32_t CORBCTL = 0x4C;   // 8
+    constexpr uint32_t CORBSIZE = 0x4E;  // 8
+    constexpr uint32_t RIRBLBASE = 0x50; // 32
+    constexpr uint32_t RIRBUBASE = 0x54; // 32
+    constexpr uint32_t RIRBWP = 0x58;    // 16
+    constexpr uint32_t RINTCNT = 0x5A;   // 16
+    constexpr uint32_t RIRBCTL = 0x5C;   // 8
+    constexpr uint32_t RIRBSTS = 0x5D;   // 8
+    constexpr uint32_t RIRBSIZE = 0x5E;  // 8
+    constexpr uint32_t DPLBASE = 0x70;   // 32
+    constexpr uint32_t DPUBASE = 0x74;   // 32
+
+    constexpr uint32_t GCTL_CRST = 1 << 0;
+    constexpr uint32_t INTCTL_GIE = 1u << 31;
+    constexpr uint16_t RP_RESET = 1 << 15; // CORBRP and RIRBWP
+    constexpr uint8_t CORBCTL_RUN = 1 << 1;
+    constexpr uint8_t RIRBCTL_DMAEN = 1 << 1;
+    constexpr uint8_t RIRBSTS_RINTFL = 1 << 0;
+    constexpr uint8_t RIRBSTS_OIS = 1 << 2;
+    constexpr uint8_t RING_SIZE_256 = 2; // CORBSIZE/RIRBSIZE
+    constexpr uint32_t DPLBASE_ENABLE = 1 << 0;
+
+    // Stream descriptor registers, relative to the descriptor; inputs come
+    // first, then outputs, 0x20 apart starting at 0x80
+    constexpr uint32_t SD_BASE = 0x80;
+    constexpr uint32_t SD_SIZE = 0x20;
+    constexpr uint32_t SD_CTL = 0x00;  // 32 (24 used)
+    constexpr uint32_t SD_STS = 0x03;  // 8
+    constexpr uint32_t SD_CBL = 0x08;  // 32: bytes in the ring
+    constexpr uint32_t SD_LVI = 0x0C;  // 16
+    constexpr uint32_t SD_FMT = 0x12;  // 16
+    constexpr uint32_t SD_BDPL = 0x18; // 32
+    constexpr uint32_t SD_BDPU = 0x1C; // 32
+
+    constexpr uint32_t CTL_SRST = 1 << 0;
+    constexpr uint32_t CTL_RUN = 1 << 1;
+    constexpr uint32_t CTL_IOCE = 1 << 2;
+    constexpr uint32_t CTL_FEIE = 1 << 3;
+    constexpr uint32_t CTL_DEIE = 1 << 4;
+    constexpr uint32_t CTL_STREAM_SHIFT = 20;
+    constexpr uint8_t STS_BCIS = 1 << 2;
+    constexpr uint8_t STS_FIFOE = 1 << 3;
+    constexpr uint8_t STS_DESE = 1 << 4;
+
+    // Stream format: 16-bit stereo, rate from a 48k or 44.1k base
+    constexpr uint16_t FMT_BASE_44K = 1 << 14;
+    constexpr uint16_t FMT_MULT_2 = 1 << 11;
+    constexpr uint16_t FMT_DIV_SHIFT = 8;
+    constexpr uint16_t FMT_16BIT = 1 << 4;
+    constexpr uint16_t FMT_STEREO = 1;
+
+    // Codec verbs and parameters
+    constexpr uint32_t VERB_GET_PARAMETER = 0xF00;
+    constexpr uint32_t VERB_SET_CONNECTION = 0x701;
+    constexpr uint32_t VERB_SET_POWER_STATE = 0x705;
+    constexpr uint32_t VERB_SET_STREAM = 0x706;
+    constexpr uint32_t VERB_SET_PIN_CONTROL = 0x707;
+    constexpr uint32_t VERB_SET_EAPD = 0x70C;
+    constexpr uint32_t VERB_SET_FORMAT = 0x2;   // 4-bit verbs, 16-bit payload
+    constexpr uint32_t VERB_SET_AMP = 0x3;
+    constexpr uint32_t PARAM_NODE_COUNT = 0x04;
+    constexpr uint32_t PARAM_FUNCTION_TYPE = 0x05;
+    constexpr uint32_t PARAM_WIDGET_CAPS = 0x09;
+    constexpr uint32_t PARAM_PCM = 0x0A;
+    constexpr uint32_t PARAM_PIN_CAPS = 0x0C;
+    constexpr uint32_t PARAM_AMP_OUT_CAPS = 0x12;
+
+    constexpr uint32_t FUNCTION_AUDIO = 0x01;
+    constexpr uint32_t WIDGET_OUTPUT = 0x0;
+    constexpr uint32_t WIDGET_PIN = 0x4;
+    constexpr uint32_t PIN_CAN_OUTPUT = 1 << 4;
+    constexpr uint32_t PIN_OUT_ENABLE = 0x40;
+    constexpr uint32_t AMP_SET_OUTPUT = 0xB000; // output amp, both channels
+
+    constexpr uint32_t STREAM_TAG = 1; // what the DAC listens for
+    constexpr uint32_t TIMEOUT = 1000000;
+
+    constexpr uint32_t BUFFER_ALIGN = 128; // where each BDL buffer may start
+
+    struct BufferDescriptor
+    {
+        uint64_t address;
+        uint32_t length; // bytes
+        uint32_t ioc;    // bit 0: interrupt when this entry completes
+    };
+
+    struct Response
+    {
+        uint32_t response;
+        uint32_t extended; // bits 3:0 the codec, bit 4 unsolicited
+    };
+    constexpr uint32_t RESPONSE_UNSOLICITED = 1 << 4;
+
+    // Rates a stream format can express and the PARAM_PCM bit saying the
+    // codec supports them
+    struct Rate
+    {
+        uint32_t hz;
+        uint16_t format;
+        uint32_t pcmBit;
+    };
+    constexpr Rate RATES[] = {
+        {8000, 5 << FMT_DIV_SHIFT, 1 << 0},
+        {11025, FMT_BASE_44K | 3 << FMT_DIV_SHIFT, 1 << 1},
+        {16000, 2 << FMT_DIV_SHIFT, 1 << 2},
+        {22050, FMT_BASE_44K | 1 << FMT_DIV_SHIFT, 1 << 3},
+        {32000, FMT_MULT_2 | 2 << FMT_DIV_SHIFT, 1 << 4},
+        {44100, FMT_BASE_44K, 1 << 5},
+        {48000, 0, 1 << 6},
+    };
+    constexpr Rate DEFAULT_RATE = {48000, 0, 1 << 6};
+
+    static volatile uint8_t *mmio = nullptr;
+    static uint32_t IRQ;
+    static uint32_t stream;   // register offset of our output stream
+    static uint32_t streamIndex; // its bit in INTCTL/INTSTS and slot in the position buffer
+
+    static volatile uint32_t *corb;
+    static volatile Response *rirb;
+    static uint32_t corbEntries;
+    static uint32_t rirbEntries;
+    static uint32_t rirbRead = 0;
+
+    static uint32_t codec;
+    static uint32_t dac;
+    static uint32_t supportedRates;
+
+    static BufferDescriptor *bdl;
+    static volatile uint32_t *positions;
+    static DMA::Region ring;
+
+    static Semaphore *completions = nullptr;
+    static volatile uint32_t completedAt = 0;
+    static volatile uint32_t fifoErrors = 0;
+
+    template <typename T>
+    static T read(uint32_t reg)
+    {
+        return *(volatile T *)(mmio + reg);
+    }
+
+    template <typename T>
+    static void write(uint32_t reg, T value)
+    {
+        *(volatile T *)(mmio + reg) = value;
+    }
+
+    // Spins until (reg & mask) == want; false if it never gets there
+    template <typename T>
+    static bool waitFor(uint32_t reg, T mask, T want)
+    {
+        for (uint32_t i = 0; i < TIMEOUT; i++)
+        {
+            if ((read<T>(reg) & mask) == want)
+            {
+                return true;
+            }
+            iAmStuckInALoop(false);
+        }
+        return false;
+    }
+
+    // Sends one verb and waits for the answer. Only init() and the mixer
+    // thread talk to the codec, never at the same time, so there is no lock.
+    static bool command(uint32_t nid, uint32_t verb, uint32_t &response)
+    {
+        uint32_t wp = (read<uint16_t>(CORBWP) + 1) % corbEntries;
+        corb[wp] = (codec << 28) | (nid << 20) | verb;
+        write<uint16_t>(CORBWP, wp);
+
+        for (uint32_t i = 0; i < TIMEOUT; i++)
+        {
+            if ((read<uint16_t>(RIRBWP) & 0xFF) == rirbRead)
+            {
+                iAmStuckInALoop(false);
+                continue;
+            }
+            rirbRead = (rirbRead + 1) % rirbEntries;
+            uint32_t answer = rirb[rirbRead].response;
+            uint32_t extended = rirb[rirbRead].extended;
+            // lets the controller send the next response
+            write<uint8_t>(RIRBSTS, RIRBSTS_RINTFL | RIRBSTS_OIS);
+            if (extended & RESPONSE_UNSOLICITED)
+            {
+                continue;
+            }
+            response = answer;
+            return true;
+        }
+        Debug::printf("| HDA: codec %d node %d did not answer verb 0x%x\n", codec, nid, verb);
+        return false;
+    }
+
+    static uint32_t verb(uint32_t nid, uint32_t verb, uint32_t payload)
+    {
+        uint32_t response = 0;
+        command(nid, (verb << 8) | payload, response);
+        return response;
+    }
+
+    // The "set format" and "set amp" verbs are 4 bits with 16 bits of payload
+    static uint32_t verb16(uint32_t nid, uint32_t verb, uint32_t payload)
+    {
+        uint32_t response = 0;
+        command(nid, (verb << 16) | payload, response);
+        return response;
+    }
+
+    static uint32_t parameter(uint32_t nid, uint32_t id)
+    {
+        return verb(nid, VERB_GET_PARAMETER, id);
+    }
+
+    static bool resetController()
+    {
+        write<uint32_t>(GCTL, read<uint32_t>(GCTL) & ~GCTL_CRST);
+        if (!waitFor<uint32_t>(GCTL, GCTL_CRST, 0))
+        {
+            return false;
+        }
+        write<uint32_t>(GCTL, read<uint32_t>(GCTL) | GCTL_CRST);
+        if (!waitFor<uint32_t>(GCTL, GCTL_CRST, GCTL_CRST))
+        {
+            return false;
+        }
+        // codecs take a moment to say they're there
+        for (uint32_t i = 0; i < TIMEOUT && read<uint16_t>(STATESTS) == 0; i++)
+        {
+            iAmStuckInALoop(false);
+        }
+        return read<uint16_t>(STATESTS) != 0;
+    }
+
+    // Picks the biggest ring size the register says is available (256, 16
+    // or 2 entries) and returns the number of entries
+    static uint32_t ringSize(uint32_t reg)
+    {
+        uint8_t caps = read<uint8_t>(reg) >> 4;
+        uint8_t size = (caps & 4) ? RING_SIZE_256 : (caps & 2) ? 1 : 0;
+        write<uint8_t>(reg, (read<uint8_t>(reg) & ~3) | size);
+        return size == RING_SIZE_256 ? 256 : size == 1 ? 16 : 2;
+    }
+
+    static bool setupRings()
+    {
+        auto corbMem = DMA::alloc(256 * sizeof(uint32_t), 128);
+        auto rirbMem = DMA::alloc(256 * sizeof(Response), 128);
+        if (corbMem.isNull() || rirbMem.isNull())
+        {
+            return false;
+        }
+        corb = corbMem.virt<uint32_t>();
+        rirb = rirbMem.virt<Response>();
+
+        write<uint8_t>(CORBCTL, 0);
+        write<uint8_t>(RIRBCTL, 0);
+        waitFor<uint8_t>(CORBCTL, CORBCTL_RUN, 0);
+        waitFor<uint8_t>(RIRBCTL, RIRBCTL_DMAEN, 0);
+
+        corbEntries = ringSize(CORBSIZE);
+        write<uint32_t>(CORBLBASE, corbMem.phys());
+        write<uint32_t>(CORBUBASE, 0);
+        // the reset bit reads back as set on real hardware only, don't insist
+        write<uint16_t>(CORBRP, RP_RESET);
+        waitFor<uint16_t>(CORBRP, RP_RESET, RP_RESET);
+        write<uint16_t>(CORBRP, 0);
+        waitFor<uint16_t>(CORBRP, RP_RESET, 0);
+        write<uint16_t>(CORBWP, 0);
+
+        rirbEntries = ringSize(RIRBSIZE);
+        write<uint32_t>(RIRBLBASE, rirbMem.phys());
+        write<uint32_t>(RIRBUBASE, 0);
+        write<uint16_t>(RIRBWP, RP_RESET);
+        write<uint16_t>(RINTCNT, 1);
+        rirbRead = 0;
+
+        write<uint8_t>(CORBCTL, CORBCTL_RUN);
+        write<uint8_t>(RIRBCTL, RIRBCTL_DMAEN);
+        return true;
+    }
+
+    // Finds a DAC and an output pin in the first audio function group of
+    // the first codec that answered and wires them up to STREAM_TAG
+    static bool setupCodec()
+    {
+        codec = __builtin_ctz(read<uint16_t>(STATESTS));
+
+        uint32_t pin = 0;
+        uint32_t nodes = parameter(0, PARAM_NODE_COUNT);
+        for (uint32_t fg = (nodes >> 16) & 0xFF; fg < ((nodes >> 16) & 0xFF) + (nodes & 0xFF); fg++)
+        {
+            if ((parameter(fg, PARAM_FUNCTION_TYPE) & 0xFF) != FUNCTION_AUDIO)
+            {
+                continue;
+            }
+            verb(fg, VERB_SET_POWER_STATE, 0); // D0
+
+            uint32_t widgets = parameter(fg, PARAM_NODE_COUNT);
+            uint32_t first = (widgets >> 16) & 0xFF;
+            for (uint32_t w = first; w < first + (widgets & 0xFF); w++)
+            {
+                uint32_t type = (parameter(w, PARAM_WIDGET_CAPS) >> 20) & 0xF;
+                if (type == WIDGET_OUTPUT && dac == 0)
+                {
+                    dac = w;
+                }
+                else if (type == WIDGET_PIN && pin == 0 && (parameter(w, PARAM_PIN_CAPS) & PIN_CAN_OUTPUT))
+                {
+                    pin = w;
+                }
+            }
+
+            supportedRates = parameter(dac, PARAM_PCM);
+            if ((supportedRates & 0xFFF) == 0)
+            {
+                supportedRates = parameter(fg, PARAM_PCM);
+            }
+            break;
+        }
+        if (dac == 0)
+        {
+            return false;
+        }
+
+        // 0dB is the amp's offset, which is where the DAC passes samples
+        // through unchanged
+        uint32_t gain = parameter(dac, PARAM_AMP_OUT_CAPS) & 0x7F;
+        verb16(dac, VERB_SET_AMP, AMP_SET_OUTPUT | gain);
+        verb(dac, VERB_SET_STREAM, STREAM_TAG << 4);
+        if (pin != 0)
+        {
+            verb(pin, VERB_SET_CONNECTION, 0);
+            verb(pin, VERB_SET_PIN_CONTROL, PIN_OUT_ENABLE);
+            verb(pin, VERB_SET_EAPD, 0x02);
+            gain = parameter(pin, PARAM_AMP_OUT_CAPS) & 0x7F;
+            verb16(pin, VERB_SET_AMP, AMP_SET_OUTPUT | gain);
+        }
+        Debug::printf("| HDA codec %d: DAC node %d, pin node %d, rates 0x%x\n", codec, dac, pin, supportedRates & 0xFFF);
+        return true;
+    }
+
+    static bool setupStream()
+    {
+        uint16_t gcap = read<uint16_t>(GCAP);
+        uint32_t inputs = (gcap >> 8) & 0xF;
+        uint32_t outputs = (gcap >> 12) & 0xF;
+        uint32_t bidirectional = (gcap >> 3) & 0x1F;
+        if (outputs == 0 && bidirectional == 0)
+        {
+            return false;
+        }
+        // bidirectional streams come after the outputs and play just as well
+        streamIndex = inputs;
+        stream = SD_BASE + streamIndex * SD_SIZE;
+
+        auto list = DMA::alloc(MAX_ENTRIES * sizeof(BufferDescriptor), 128);
+        auto pos = DMA::alloc((inputs + outputs + bidirectional) * 8, 128);
+        // the ring takes what the DMA pool has left, up to RING_BYTES
+        for (uint32_t bytes = RING_BYTES; bytes >= MIN_RING_BYTES && ring.isNull(); bytes /= 2)
+        {
+            ring = DMA::alloc(bytes, PhysMem::FRAME_SIZE);
+        }
+        if (list.isNull() || pos.isNull() || ring.isNull())
+        {
+            return false;
+        }
+        bdl = list.virt<BufferDescriptor>();
+        positions = pos.virt<uint32_t>();
+        write<uint32_t>(DPUBASE, 0);
+        write<uint32_t>(DPLBASE, pos.phys() | DPLBASE_ENABLE);
+        return true;
+    }
+
+    static const Rate &pickRate(uint32_t hz)
+    {
+        for (auto &r : RATES)
+        {
+            if (r.hz == hz && (supportedRates & r.pcmBit))
+            {
+                return r;
+            }
+        }
+        // the mixer resamples to whatever we say
+        return DEFAULT_RATE;
+    }
+
+    static void resetStream()
+    {
+        write<uint32_t>(stream + SD_CTL, read<uint32_t>(stream + SD_CTL) & ~CTL_RUN);
+        waitFor<uint32_t>(stream + SD_CTL, CTL_RUN, 0);
+        write<uint32_t>(stream + SD_CTL, read<uint32_t>(stream + SD_CTL) | CTL_SRST);
+        waitFor<uint32_t>(stream + SD_CTL, CTL_SRST, CTL_SRST);
+        write<uint32_t>(stream + SD_CTL, read<uint32_t>(stream + SD_CTL) & ~CTL_SRST);
+        waitFor<uint32_t>(stream + SD_CTL, CTL_SRST, 0);
+        write<uint8_t>(stream + SD_STS, STS_BCIS | STS_FIFOE | STS_DESE);
+    }
+
+    // The ring is fixed once running: `count` slots of `slotFrames` back
+    // to back in `ring`, and the controller loops over all of them until
+    // halted. The mixer keeps every slot but the one playing full.
+    class Output : public AudioBackend
+    {
+        uint32_t slotFrames = 0;
+        uint32_t count = 0;
+
+    public:
+        const char *name() override { return "HDA"; }
+        uint32_t maxSlots() override { return MAX_ENTRIES; }
+        uint32_t maxFrames() override { return ring.bytes / 4 / 2; }
+
+        uint32_t start(uint32_t rate, uint32_t &frames, uint32_t &slots) override
+        {
+            resetStream();
+
+            if (frames > maxFrames())
+                frames = maxFrames();
+            // every BDL buffer has to start on a 128 byte boundary
+            frames &= ~(BUFFER_ALIGN / 4 - 1);
+            if (slots > MAX_ENTRIES)
+                slots = MAX_ENTRIES;
+            if (slots * frames * 4 > ring.bytes)
+                slots = ring.bytes / (frames * 4);
+            slotFrames = frames;
+            count = slots;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                bdl[i].address = ring.phys() + i * slotFrames * 4;
+                bdl[i].length = slotFrames * 4;
+                bdl[i].ioc = 1;
+            }
+
+            const Rate &r = pickRate(rate);
+            uint16_t format = r.format | FMT_16BIT | FMT_STEREO;
+            verb16(dac, VERB_SET_FORMAT, format);
+
+            write<uint32_t>(stream + SD_BDPL, DMA::phys(bdl));
+            write<uint32_t>(stream + SD_BDPU, 0);
+            write<uint32_t>(stream + SD_CBL, count * slotFrames * 4);
+            write<uint16_t>(stream + SD_LVI, count - 1);
+            write<uint16_t>(stream + SD_FMT, format);
+            uint32_t ctl = read<uint32_t>(stream + SD_CTL) & ~(0xF << CTL_STREAM_SHIFT);
+            write<uint32_t>(stream + SD_CTL, ctl | (STREAM_TAG << CTL_STREAM_SHIFT) | CTL_IOCE | CTL_FEIE | CTL_DEIE);
+            positions[streamIndex * 2] = 0;
+            return r.hz;
+        }
+
+        void run(uint32_t lastValid) override
+        {
+            write<uint32_t>(stream + SD_CTL, read<uint32_t>(stream + SD_CTL) | CTL_RUN);
+        }
+
+        uint32_t slots() override { return count; }
+        bool resizable() override { return false; }
+
+        int16_t *buffer(uint32_t i) override
+        {
+            return (int16_t *)(ring.virt<char>() + i * slotFrames * 4);
+        }
+
+        uint32_t frames(uint32_t i) override { return slotFrames; }
+        void setFrames(uint32_t i, uint32_t frames) override {}
+
+        // Every slot is always valid, the controller doesn't stop for them
+        void setLastValid(uint32_t i) override {}
+
+        uint32_t position(uint32_t &current) override
+        {
+            // one memory read, written by the controller as it goes
+            uint32_t bytes = positions[streamIndex * 2];
+            uint32_t slotBytes = slotFrames * 4;
+            current = (bytes / slotBytes) % count;
+            return (slotBytes - bytes % slotBytes) / 4;
+        }
+
+        void waitForBuffer() override { completions->down(); }
+
+        void halt() override
+        {
+            resetStream();
+        }
+
+        uint32_t completedAt() override { return HDA::completedAt; }
+        // it loops instead of running dry
+        uint32_t lastValidEvents() override { return 0; }
+        uint32_t fifoErrors() override { return HDA::fifoErrors; }
+    };
+
+    static Output output;
+    static bool found = false;
+
+    bool init(uint32_t address, uint32_t irq)
+    {
+        // 16KB of registers; kernel only, but in every address space
+        VMM::mapDevice(address, 0x4000);
+        mmio = (volatile uint8_t *)address;
+        IRQ = irq;
+
+        if (!resetController())
+        {
+            Debug::printf("| HDA: no codec after reset\n");
+            return false;
+        }
+        if (!setupRings() || !setupStream())
+        {
+            Debug::printf("| HDA: no DMA memory or output stream\n");
+            return false;
+        }
+        if (!setupCodec())
+        {
+            Debug::printf("| HDA: no audio output on the codec\n");
+            return false;
+        }
+
+        completions = new Semaphore(0);
+        IDT::interrupt(HDA_vector, (uint32_t)hdaHandler_);
+        IOAPIC::route(IRQ, HDA_vector, SMP::me(), true);
+        write<uint32_t>(INTCTL, INTCTL_GIE | (1 << streamIndex));
+
+        Debug::printf("| HDA controller at 0x%x, output stream %d\n", address, streamIndex);
+        found = true;
+        return true;
+    }
+
+    bool present()
+    {
+        return found;
+    }
+
+    static bool probe(const PCI::Device &d)
+    {
+        if (found)
+        {
+            return false;
+        }
+        Debug::printf("| Found HDA.\n");
+        PCI::enable(d, PCI::COMMAND_MEMORY | PCI::COMMAND_BUS_MASTER);
+        return init(d.memBase(0), d.irq);
+    }
+
+    void registerDriver()
+    {
+        PCI::registerDriver(PCI::Driver{"HDA", PCI::ANY, PCI::ANY, HDA_CLASS, probe});
+    }
+
+    AudioBackend *backend()
+    {
+        return &output;
+    }
+}
+
+extern "C" void hdaHandler(uint32_t *things)
+{
+    // interrupts are disabled.
+    using namespace HDA;
+    uint8_t sts = read<uint8_t>(stream + SD_STS);
+    // the line is level triggered, acknowledge before the EOI
+    write<uint8_t>(stream + SD_STS, sts & (STS_BCIS | STS_FIFOE | STS_DESE));
+    SMP::eoi_reg.set(0);
+    if (sts & STS_FIFOE)
+    {
+        fifoErrors++;
+    }
+    if ((sts & STS_BCIS) && completions != nullptr)
+    {
+        completedAt = (uint32_t)rdtsc();
+        completions->up();
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef _HDA_H_
+#define _HDA_H_
+
+#include "stdint.h"
+#include "audiobackend.h"
+
+// Intel High Definition Audio controller, e.g. QEMU's intel-hda with an
+// hda-output (or hda-duplex) codec. Registers are memory mapped and the
+// codec is programmed with verbs through the CORB/RIRB rings. Playback
+// uses the first output stream: a BDL of up to MAX_ENTRIES slots that the
+// controller loops over, with the play position coming from the DMA
+// position buffer in memory rather than from a register.
+namespace HDA
+{
+    constexpr uint32_t MAX_ENTRIES = 256;                   // BDL entries the spec allows
+    constexpr uint32_t RING_BYTES = MAX_ENTRIES * 2048 * 4; // every slot a full period, 2MB
+    constexpr uint32_t MIN_RING_BYTES = 64 * 1024;          // less than this and init() fails
+
+    // Tells PCI to hand us the first HD audio controller (by class)
+    extern void registerDriver();
+    // Brings up the controller whose registers are at physical address
+    // `mmio` and takes interrupts on `irq`. False if there is no codec with
+    // an audio output on the link.
+    extern bool init(uint32_t mmio, uint32_t irq);
+    extern bool present();
+    // the output stream for the mixer
+    extern AudioBackend *backend();
+}
+
+#endif
@@ -18,6 +18,10 @@
 #include "sys.h"
 #include "process.h"
 #include "pci.h"
+#include "ac97.h"
+#include "hda.h"
+#include "audio.h"
+#include "dma.h"
 
 struct Stack {
     static constexpr int BYTES = 4096;
@@ -39,6 +43,7 @@ bool onHypervisor = true;
 static constexpr uint32_t HEAP_START = 1 * 1024 * 1024;
 static constexpr uint32_t HEAP_SIZE = 5 * 1024 * 1024;
 static constexpr uint32_t VMM_FRAMES = HEAP_START + HEAP_SIZE;
+static constexpr uint32_t DMA_POOL_SIZE = 1 * 1024 * 1024;
 
 extern "C" void kernelInit(void) {
 
@@ -102,6 +107,9 @@ extern "C" void kernelInit(void) {
         /* initialize physmem */
         PhysMem::init(VMM_FRAMES, kConfig.memSize - VMM_FRAMES);
 
+        /* device buffers get their own contiguous pool */
+        DMA::init(PhysMem::reserve(DMA_POOL_SIZE), DMA_POOL_SIZE);
+
         /* running global constructors */
         //CRT::init();
 
@@ -123,8 +131,20 @@ extern "C" void kernelInit(void) {
         SMP::init(true);
         smpInitDone = true;
         
-        /* initialize AC97 Device */
-        PCI::findAC97();
+        /* find PCI devices and hand them to their drivers */
+        PCI::scan();
+        HDA::registerDriver();
+        AC97::registerDriver();
+        PCI::probe();
+
+        /* HDA plays if it's there; an AC97 still does capture */
+        if (HDA::present()) {
+            Audio::use(HDA::backend());
+        } else if (AC97::present()) {
+            Audio::use(AC97::backend());
+        } else {
+            Debug::printf("| no sound card, audio system calls will fail\n");
+        }
 
         /* initialize IDT */
         IDT::init();
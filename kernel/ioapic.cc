@@ -0,0 +1,28 @@
+#include "ioapic.h"
+#include "config.h"
+#include "debug.h"
+
+uint32_t IOAPIC::read(uint32_t reg) {
+    volatile uint32_t* base = (volatile uint32_t*) kConfig.ioAPIC;
+    base[IOREGSEL / 4] = reg;
+    return base[IOWIN / 4];
+}
+
+void IOAPIC::write(uint32_t reg, uint32_t val) {
+    volatile uint32_t* base = (volatile uint32_t*) kConfig.ioAPIC;
+    base[IOREGSEL / 4] = reg;
+    base[IOWIN / 4] = val;
+}
+
+void IOAPIC::route(uint32_t irq, uint32_t vector, uint32_t apicId, bool level) {
+    uint32_t low = vector |            // fixed delivery, physical destination
+                   (0 << 13) |         // active high (QEMU overrides PCI links that way)
+                   ((level ? 1 : 0) << 15);
+    write(REDTBL + 2 * irq + 1, apicId << 24);
+    write(REDTBL + 2 * irq, low);
+    Debug::printf("| IOAPIC irq %d -> vector %d on apic %d\n", irq, vector, apicId);
+}
+
+void IOAPIC::mask(uint32_t irq) {
+    write(REDTBL + 2 * irq, read(REDTBL + 2 * irq) | (1 << 16));
+}
@@ -0,0 +1,22 @@
+#ifndef _IOAPIC_H_
+#define _IOAPIC_H_
+
+#include "stdint.h"
+
+// Just enough of the I/O APIC to deliver a device interrupt line to
+// a local APIC. The legacy PIC stays masked (see SMP::init).
+class IOAPIC {
+    static constexpr uint32_t IOREGSEL = 0x00;
+    static constexpr uint32_t IOWIN = 0x10;
+    static constexpr uint32_t REDTBL = 0x10;
+
+    static uint32_t read(uint32_t reg);
+    static void write(uint32_t reg, uint32_t val);
+public:
+    // Deliver `irq` as `vector` to the local APIC with the given id.
+    // PCI lines are level triggered, ISA edges are not.
+    static void route(uint32_t irq, uint32_t vector, uint32_t apicId, bool level);
+    static void mask(uint32_t irq);
+};
+
+#endif
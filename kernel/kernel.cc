@@ -4,6 +4,7 @@
 #include "ext2.h"
 #include "sys.h"
 #include "threads.h"
+#include "bench.h"
 
 const char* initName = "/sbin/init";
 
@@ -13,6 +14,10 @@ namespace gheith {
 }
 
 void kernelMain(void) {
+#ifdef AUDIO_BENCH
+    AudioBench::run();
+#endif
+
     auto argv = new const char* [2];
     argv[0] = "init";
     argv[1] = nullptr;
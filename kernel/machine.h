@@ -23,6 +23,8 @@ extern "C" void invlpg(uint32_t va);
 
 extern "C" void apitHandler_(void);
 extern "C" void spuriousHandler_(void);
+extern "C" void ac97Handler_(void);
+extern "C" void hdaHandler_(void);
 extern "C" void pageFaultHandler_(void);
 
 extern "C" void* memcpy(void *dest, const void* src, size_t n);
@@ -32,6 +34,7 @@ extern "C" void sti();
 extern "C" void cli();
 extern "C" uint32_t getCR3();
 extern "C" uint32_t getFlags();
+extern "C" uint64_t rdtsc();
 extern "C" void monitor(uintptr_t);
 extern "C" void mwait();
 
@@ -52,6 +52,13 @@ public:
         return -1;
     }
     off_t getOffset() { return myOffset; }
+    uint32_t inumber() override { return node->number; }
+    Shared<File> reopen() override
+    {
+        auto file = new OpenFileStruct(node);
+        file->myOffset = myOffset;
+        return Shared<File>{file};
+    }
 };
 
 #endif
\ No newline at end of file
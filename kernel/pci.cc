@@ -1,102 +1,18 @@
 #include "pci.h"
 #include "debug.h"
 #include "machine.h"
-#include "bb.h"
-#include "threads.h"
-#include "process.h"
-#include "pit.h"
 
 // Some of the code is from ChatGPT, some is adapted from OSDev.
 
 #define CONFIG_ADDRESS 0xCF8
 #define CONFIG_DATA 0xCFC
-#define AC97_VENDOR_ID 0x8086 // Example: Intel's vendor ID
-#define AC97_DEVICE_ID 0x2415 // Example: AC97's device ID
-bool setupBuffers = false;
 
-namespace AC97
-{
-    constexpr uint16_t AC97_RESET_REG = 0x00;
-    constexpr uint16_t AC97_MASTER_VOL_REG = 0x02;
-    constexpr uint16_t AC97_AUX_VOL_REG = 0x04;
-    constexpr uint16_t AC97_PCM_OUT_VOL_REG = 0x18;
-    constexpr uint16_t AC97_EXTENDED_AUDIO_REG = 0x28;
-    constexpr uint16_t AC97_PCM_DAC_RATE_REG = 0x2C;
-    constexpr uint16_t AC97_NABM_IO_GLOBAL_CONTROL = 0x2C;
-    constexpr uint32_t BUFFER_SIZE = 131070; // 64 KB per buffer
-    constexpr uint32_t NUM_BUFFERS = 32;
-
-    uint32_t BAR0;
-    uint32_t BAR1;
-    uint32_t GCR;
-    BufferDescriptor *audio_buffers;
-
-    bool audioPlaying = false;
-    void setupDMABuffers(uint32_t nabm_base)
-    {
-        if (setupBuffers)
-        {
-            return;
-        }
-        audio_buffers = new AC97::BufferDescriptor[NUM_BUFFERS];
-        for (uint32_t i = 0; i < NUM_BUFFERS; i++)
-        {
-            audio_buffers[i].pointer = (uint32_t) new char[BUFFER_SIZE];
-            audio_buffers[i].length = 0xFFFE;
-        }
-
-        // Assuming the first descriptor is located at nabm_base + 0x00 for PCM Out
-        // Debug::printf("| DMA buffers setup completed.\n");
-        setupBuffers = true;
-    }
-    // Initialize AC97 codec and set up basic operation
-    void initializeCodec()
-    {
-        // Properly setting global control register, ensuring correct register (0x6C)
-
-        outl(GCR, (0b00 << 22) | (0b00 << 20) | (0 << 2) | (1 << 1));
-
-        outb(BAR1 + 0xB, 0x2);
-
-        // Reset the codec by writing to the reset register using outl for 32-bit value simulation
-        outw(BAR0, 0xFF);
-
-        // Set volume levels to maximum (0x0000 is maximum, 0x8000 is mute in AC97)
-        // int temp = nam_base + AC97_MASTER_VOL_REG;
-
-        outw(BAR0 + AC97_PCM_OUT_VOL_REG, 0x0); // PCM volume to max
-
-        setupDMABuffers(BAR1);
-
-        // outl(BAR0 + AC97_MASTER_VOL_REG, 0x0000); // Master volume to max
-        // outl(BAR0 + AC97_AUX_VOL_REG, 0x0000);    // AUX volume to max
-
-        // Enable audio output
-
-        Debug::printf("| AC97 codec initialized with NAM base I/O address 0x%X and NABM base I/O address 0x%X\n", BAR0, BAR1);
-    }
-
-    void play(uint32_t duration, uint32_t jiffies)
-    {
-        // outw(BAR1 + 0x06, 0x1C);
-        outb(BAR1 + 0x0B, 0x1);
-        // Debug::printf("Started playing audio.\n");
-        uint32_t target = Pit::jiffies + Pit::secondsToJiffies(duration) + jiffies; 
-        // sti();
-        // Debug::printf("jiffies per second = %d\n", Pit::secondsToJiffies(30));
-        while (Pit::jiffies < target)
-        {
-            iAmStuckInALoop(true);
-        }
-        outb(BAR1 + 0x0B, 0x2);
-        // Debug::printf("Finished playing audio.\n");
-    }
-
-    bool isPlaying()
-    {
-        return audioPlaying;
-    }
-}
+#define HEADER_TYPE_MASK 0x7F
+#define HEADER_MULTIFUNCTION 0x80
+#define HEADER_GENERAL 0x00
+#define HEADER_BRIDGE 0x01
+#define HEADER_CARDBUS 0x02
+#define CLASS_PCI_BRIDGE 0x0604
 
 namespace PCI
 {
@@ -132,56 +48,180 @@ namespace PCI
         outl(CONFIG_DATA, data);
     }
 
-    void enablePCICommandRegister(uint8_t bus, uint8_t device, uint8_t function)
+    void enablePCICommandRegister(uint8_t bus, uint8_t device, uint8_t function, uint16_t enable)
     {
         // Read the current value of the command register
         uint16_t command_register = pciConfigReadWord(bus, device, function, 0x04);
 
-        // Set bit 0 (Enable I/O space) and bit 2 (Enable bus mastering)
-        command_register |= 0x0005;
+        // Set bit 0 (I/O space), bit 1 (memory space) and/or bit 2 (bus mastering)
+        command_register |= enable;
 
         // Write the modified command register back to the PCI configuration space
         pciConfigWriteWord(bus, device, function, 0x04, command_register);
         Debug::printf("| Enabled PCI register\n");
     }
 
-    void findAC97()
+    void enable(const Device &d, uint16_t bits)
+    {
+        enablePCICommandRegister(d.bus, d.slot, d.func, bits);
+    }
+
+    static Device devices[MAX_DEVICES];
+    static uint32_t nDevices = 0;
+    static uint32_t busesSeen[256 / 32]; // so a bridge loop can't send us around forever
+    static uint32_t configReads = 0;
+
+    static uint32_t readConfig(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+    {
+        configReads++;
+        return pciConfigReadDWord(bus, slot, func, offset);
+    }
+
+    static void scanBus(uint8_t bus);
+
+    // Records one function given its first dword (device << 16 | vendor).
+    // Returns the raw header type.
+    static uint8_t scanFunction(uint8_t bus, uint8_t slot, uint8_t func, uint32_t id)
+    {
+        uint32_t classes = readConfig(bus, slot, func, 0x08);
+        uint8_t header = (readConfig(bus, slot, func, 0x0C) >> 16) & 0xFF;
+        if (nDevices == MAX_DEVICES)
+        {
+            Debug::printf("| PCI: more than %d functions, ignoring %d:%d.%d\n", MAX_DEVICES, bus, slot, func);
+            return header;
+        }
+
+        Device &d = devices[nDevices++];
+        d.bus = bus;
+        d.slot = slot;
+        d.func = func;
+        d.headerType = header & HEADER_TYPE_MASK;
+        d.vendor = id & 0xFFFF;
+        d.device = id >> 16;
+        d.classCode = classes >> 16;
+        d.progIf = (classes >> 8) & 0xFF;
+        d.driver = nullptr;
+
+        // general devices have six BARs, bridges two; cardbus none we care about
+        uint32_t bars = d.headerType == HEADER_GENERAL ? 6 : d.headerType == HEADER_BRIDGE ? 2 : 0;
+        for (uint32_t b = 0; b < 6; b++)
+        {
+            d.bar[b] = b < bars ? readConfig(bus, slot, func, 0x10 + b * 4) : 0;
+        }
+        d.irq = d.headerType == HEADER_CARDBUS ? 0xFF : readConfig(bus, slot, func, 0x3C) & 0xFF;
+
+        if (d.headerType == HEADER_BRIDGE && d.classCode == CLASS_PCI_BRIDGE)
+        {
+            scanBus((readConfig(bus, slot, func, 0x18) >> 8) & 0xFF);
+        }
+        return header;
+    }
+
+    static void scanSlot(uint8_t bus, uint8_t slot)
     {
-        uint8_t bus = 0;
-        uint8_t device = 0;
-        for (bus = 0; bus < 255; bus++)
+        uint32_t id = readConfig(bus, slot, 0, 0x00);
+        if ((id & 0xFFFF) == 0xFFFF)
         {
-            for (device = 0; device < 32; device++)
+            return;
+        }
+        if ((scanFunction(bus, slot, 0, id) & HEADER_MULTIFUNCTION) == 0)
+        {
+            return;
+        }
+        for (uint8_t func = 1; func < 8; func++)
+        {
+            id = readConfig(bus, slot, func, 0x00);
+            if ((id & 0xFFFF) != 0xFFFF)
+            {
+                scanFunction(bus, slot, func, id);
+            }
+        }
+    }
+
+    static void scanBus(uint8_t bus)
+    {
+        if (busesSeen[bus / 32] & (1 << (bus % 32)))
+        {
+            return;
+        }
+        busesSeen[bus / 32] |= 1 << (bus % 32);
+        for (uint8_t slot = 0; slot < 32; slot++)
+        {
+            scanSlot(bus, slot);
+        }
+    }
+
+    void scan()
+    {
+        // a multifunction host bridge means one host controller (and bus)
+        // per function
+        uint32_t header = readConfig(0, 0, 0, 0x0C) >> 16;
+        if ((header & HEADER_MULTIFUNCTION) == 0)
+        {
+            scanBus(0);
+        }
+        else
+        {
+            for (uint8_t func = 0; func < 8; func++)
             {
-                // Debug::printf("Testing bus %d device %d\n", bus, device);
-                uint16_t vendor_id = pciConfigReadWord(bus, device, 0, 0);
-                uint16_t device_id = pciConfigReadWord(bus, device, 0, 2);
-                // if (bus == 0 && device == 4)
-                // {
-                // Debug::printf("Suppose to be AC97 vendor_id = %d device_id = %d\n", vendor_id, device_id);
-                // }
-                if (vendor_id == 0xFFFF)
+                if ((readConfig(0, 0, func, 0x00) & 0xFFFF) != 0xFFFF)
                 {
-                    continue;
+                    scanBus(func);
                 }
+            }
+        }
+
+        for (uint32_t i = 0; i < nDevices; i++)
+        {
+            auto &d = devices[i];
+            Debug::printf("| PCI %d:%d.%d %x:%x class %x irq %d\n", d.bus, d.slot, d.func, d.vendor, d.device, d.classCode, d.irq);
+        }
+        Debug::printf("| PCI: %d functions, %d config reads\n", nDevices, configReads);
+    }
+
+    uint32_t deviceCount()
+    {
+        return nDevices;
+    }
+
+    const Device &device(uint32_t i)
+    {
+        return devices[i];
+    }
+
+    static Driver drivers[MAX_DRIVERS];
+    static uint32_t nDrivers = 0;
 
-                if (vendor_id == AC97_VENDOR_ID && device_id == AC97_DEVICE_ID)
+    void registerDriver(const Driver &driver)
+    {
+        if (nDrivers == MAX_DRIVERS)
+        {
+            Debug::panic("PCI: too many drivers\n");
+        }
+        drivers[nDrivers++] = driver;
+    }
+
+    static bool matches(const Driver &driver, const Device &d)
+    {
+        return (driver.vendor == ANY || driver.vendor == d.vendor) &&
+               (driver.device == ANY || driver.device == d.device) &&
+               (driver.classCode == ANY || driver.classCode == d.classCode);
+    }
+
+    void probe()
+    {
+        for (uint32_t k = 0; k < nDrivers; k++)
+        {
+            auto &driver = drivers[k];
+            for (uint32_t i = 0; i < nDevices; i++)
+            {
+                auto &d = devices[i];
+                if (d.driver == nullptr && matches(driver, d) && driver.probe(d))
                 {
-                    Debug::printf("| Found AC97.\n");
-                    enablePCICommandRegister(bus, device, 0);
-                    uint32_t nam_base = pciConfigReadDWord(bus, device, 0, 0x10);
-                    uint32_t nabm_base = pciConfigReadDWord(bus, device, 0, 0x14);
-                    nam_base &= ~0x3;
-                    nabm_base &= ~0x3;
-                    AC97::BAR0 = nam_base;
-                    AC97::BAR1 = nabm_base + 0x10;
-                    AC97::GCR = nabm_base + 0x2C;
-                    AC97::initializeCodec();
-                    // gheith::current()->process->setupDMABuffers(nabm_base);
-                    return;
+                    d.driver = driver.name;
+                    Debug::printf("| PCI %d:%d.%d taken by %s\n", d.bus, d.slot, d.func, driver.name);
                 }
             }
         }
-        Debug::panic("XXX AC97 sound card not found\n");
     }
 }
@@ -3,31 +3,67 @@
 #define PCI_H
 
 #include <stdint.h>
-#include "machine.h"
 
 // Function declarations
 namespace PCI
 {
     extern uint16_t pciConfigReadWord(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
-    extern void findAC97();
-}
+    extern uint32_t pciConfigReadDWord(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
 
-namespace AC97
-{
-    struct BufferDescriptor
+    constexpr uint16_t COMMAND_IO = 0x0001;
+    constexpr uint16_t COMMAND_MEMORY = 0x0002;
+    constexpr uint16_t COMMAND_BUS_MASTER = 0x0004;
+
+    // A function found by scan(), with what drivers usually want from its
+    // configuration header
+    struct Device
+    {
+        uint8_t bus;
+        uint8_t slot;
+        uint8_t func;
+        uint8_t headerType; // without the multifunction bit
+        uint16_t vendor;
+        uint16_t device;
+        uint16_t classCode; // class << 8 | subclass
+        uint8_t progIf;
+        uint8_t irq;        // interrupt line, 0xFF if none
+        uint32_t bar[6];    // as read; bridges only have the first two
+        const char *driver; // who took it, nullptr if nobody
+
+        uint32_t ioBase(uint32_t i) const { return bar[i] & ~0x3; }
+        uint32_t memBase(uint32_t i) const { return bar[i] & ~0xF; }
+    };
+
+    constexpr uint32_t MAX_DEVICES = 64;
+
+    // Walks the buses once, from bus 0 through the bridges it finds, so
+    // buses that aren't there are never touched. Functions 1-7 are only
+    // looked at on multifunction devices. Called once at boot.
+    extern void scan();
+    extern uint32_t deviceCount();
+    extern const Device &device(uint32_t i);
+
+    // Turns on bits in the command register (COMMAND_*)
+    extern void enable(const Device &d, uint16_t bits);
+
+    // Matches devices by vendor/device id or by class; ANY matches
+    // everything. probe() returns true if it took the device.
+    constexpr uint16_t ANY = 0xFFFF;
+    struct Driver
     {
-        uint32_t pointer; // Physical address of the buffer
-        uint16_t length;  // Length of the buffer in samples
-        uint16_t reserved;
+        const char *name;
+        uint16_t vendor;
+        uint16_t device;
+        uint16_t classCode;
+        bool (*probe)(const Device &d);
     };
-    extern uint32_t BAR0;
-    extern uint32_t BAR1;
-    extern uint32_t GCR;
-    extern BufferDescriptor* audio_buffers;
-
-    extern bool audioPlaying;
-    extern void play(uint32_t duration, uint32_t jiffies);
-    extern bool isPlaying();
+
+    constexpr uint32_t MAX_DRIVERS = 16;
+    extern void registerDriver(const Driver &driver);
+
+    // Offers every device nobody has taken yet to every driver that
+    // matches it, drivers in the order they registered
+    extern void probe();
 }
 
 #endif // PCI_H
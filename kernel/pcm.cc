@@ -0,0 +1,265 @@
+#include "pcm.h"
+
+// The kernel is built with -mno-sse (and doesn't save FPU state), so all
+// of this is integer code. Where the layout allows it, a 32-bit word is
+// treated as a small vector of samples (SWAR) so every load and store
+// moves more than one sample.
+
+namespace PCM
+{
+    bool describe(uint16_t formatTag, uint16_t channels, uint16_t bits, uint16_t blockAlign, Format &format)
+    {
+        if (channels == 0 || blockAlign != channels * ((bits + 7) / 8))
+        {
+            return false;
+        }
+        if (formatTag == WAVE_FORMAT_PCM)
+        {
+            if (bits != 8 && bits != 16 && bits != 24 && bits != 32)
+            {
+                return false;
+            }
+        }
+        else if (formatTag == WAVE_FORMAT_IEEE_FLOAT)
+        {
+            if (bits != 32)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+        format.encoding = formatTag;
+        format.channels = channels;
+        format.bits = bits;
+        format.frameBytes = blockAlign;
+        return true;
+    }
+
+    // packs a left and a right sample into one stereo frame word
+    static inline uint32_t frame(uint32_t l, uint32_t r)
+    {
+        return (l & 0xFFFF) | (r << 16);
+    }
+
+    static inline uint32_t mono(uint32_t s)
+    {
+        return (s & 0xFFFF) | (s << 16);
+    }
+
+    // IEEE single to Q15 with clipping, using integer ops only
+    static inline uint32_t fromFloat(uint32_t f)
+    {
+        uint32_t exp = (f >> 23) & 0xFF;
+        int32_t v;
+        if (exp >= 127)
+        {
+            v = 32767; // |x| >= 1.0 (and inf/nan) clip
+        }
+        else if (exp < 127 - 15)
+        {
+            v = 0; // below 1 LSB
+        }
+        else
+        {
+            uint32_t mant = (f & 0x7FFFFF) | 0x800000;
+            v = mant >> (127 + 8 - exp);
+        }
+        if (f & 0x80000000)
+        {
+            v = (v == 32767) ? -32768 : -v;
+        }
+        return (uint32_t)v;
+    }
+
+    // one sample of an arbitrary layout, for the channel counts we don't special-case
+    static inline uint32_t sample(const Format &format, const uint8_t *p)
+    {
+        switch (format.bits)
+        {
+        case 8:
+            return (uint32_t)(p[0] ^ 0x80) << 8;
+        case 16:
+            return p[0] | (p[1] << 8);
+        case 24:
+            return p[1] | (p[2] << 8);
+        default:
+        {
+            uint32_t w = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+            return (format.encoding == WAVE_FORMAT_IEEE_FLOAT) ? fromFloat(w) : (w >> 16);
+        }
+        }
+    }
+
+    static void u8(const uint32_t *in, uint32_t *out, uint32_t frames, bool stereo)
+    {
+        // unsigned to signed is a flip of each byte's top bit
+        if (stereo)
+        {
+            uint32_t n = frames / 2;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                uint32_t w = in[i] ^ 0x80808080;
+                out[0] = ((w & 0x000000FF) << 8) | ((w & 0x0000FF00) << 16);
+                out[1] = ((w & 0x00FF0000) >> 8) | (w & 0xFF000000);
+                out += 2;
+            }
+            if (frames & 1)
+            {
+                uint32_t w = in[n] ^ 0x80808080;
+                out[0] = ((w & 0x000000FF) << 8) | ((w & 0x0000FF00) << 16);
+            }
+        }
+        else
+        {
+            uint32_t n = frames / 4;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                uint32_t w = in[i] ^ 0x80808080;
+                uint32_t a = (w & 0x000000FF) << 8;
+                uint32_t b = w & 0x0000FF00;
+                uint32_t c = (w & 0x00FF0000) >> 8;
+                uint32_t d = (w & 0xFF000000) >> 16;
+                out[0] = a | (a << 16);
+                out[1] = b | (b << 16);
+                out[2] = c | (c << 16);
+                out[3] = d | (d << 16);
+                out += 4;
+            }
+            const uint8_t *tail = (const uint8_t *)(in + n);
+            for (uint32_t i = 0; i < (frames & 3); i++)
+            {
+                *out++ = mono((uint32_t)(tail[i] ^ 0x80) << 8);
+            }
+        }
+    }
+
+    static void s16mono(const uint32_t *in, uint32_t *out, uint32_t frames)
+    {
+        uint32_t n = frames / 2;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t w = in[i];
+            out[0] = (w & 0xFFFF) | (w << 16);
+            out[1] = (w >> 16) | (w & 0xFFFF0000);
+            out += 2;
+        }
+        if (frames & 1)
+        {
+            *out = mono(in[n]);
+        }
+    }
+
+    static void s24(const uint32_t *in, uint32_t *out, uint32_t frames, bool stereo)
+    {
+        // three words hold four packed samples; keep the top two bytes of each
+        uint32_t samples = stereo ? frames * 2 : frames;
+        uint32_t n = samples / 4;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t w0 = in[0];
+            uint32_t w1 = in[1];
+            uint32_t w2 = in[2];
+            uint32_t s0 = w0 >> 8;
+            uint32_t s1 = w1;
+            uint32_t s2 = (w1 >> 24) | (w2 << 8);
+            uint32_t s3 = w2 >> 16;
+            if (stereo)
+            {
+                out[0] = frame(s0, s1);
+                out[1] = frame(s2, s3);
+                out += 2;
+            }
+            else
+            {
+                out[0] = mono(s0);
+                out[1] = mono(s1);
+                out[2] = mono(s2);
+                out[3] = mono(s3);
+                out += 4;
+            }
+            in += 3;
+        }
+        const uint8_t *p = (const uint8_t *)in;
+        for (uint32_t i = n * 4; i < samples; i += stereo ? 2 : 1)
+        {
+            uint32_t l = p[1] | (p[2] << 8);
+            if (stereo)
+            {
+                *out++ = frame(l, p[4] | (p[5] << 8));
+                p += 6;
+            }
+            else
+            {
+                *out++ = mono(l);
+                p += 3;
+            }
+        }
+    }
+
+    static void s32(const uint32_t *in, uint32_t *out, uint32_t frames, bool stereo, bool isFloat)
+    {
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            uint32_t l = isFloat ? fromFloat(in[0]) : (in[0] >> 16);
+            if (stereo)
+            {
+                uint32_t r = isFloat ? fromFloat(in[1]) : (in[1] >> 16);
+                out[i] = frame(l, r);
+                in += 2;
+            }
+            else
+            {
+                out[i] = mono(l);
+                in += 1;
+            }
+        }
+    }
+
+    void toStereo16(const Format &format, const void *src, int16_t *dst, uint32_t frames)
+    {
+        const uint32_t *in = (const uint32_t *)src;
+        uint32_t *out = (uint32_t *)dst;
+
+        if (format.channels <= 2)
+        {
+            bool stereo = format.channels == 2;
+            switch (format.bits)
+            {
+            case 8:
+                u8(in, out, frames, stereo);
+                return;
+            case 16:
+                if (stereo)
+                {
+                    for (uint32_t i = 0; i < frames; i++)
+                    {
+                        out[i] = in[i];
+                    }
+                }
+                else
+                {
+                    s16mono(in, out, frames);
+                }
+                return;
+            case 24:
+                s24(in, out, frames, stereo);
+                return;
+            case 32:
+                s32(in, out, frames, stereo, format.encoding == WAVE_FORMAT_IEEE_FLOAT);
+                return;
+            }
+        }
+
+        // surround and friends: keep the front pair
+        const uint8_t *p = (const uint8_t *)src;
+        uint32_t bytes = format.bits / 8;
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            out[i] = frame(sample(format, p), sample(format, p + bytes));
+            p += format.frameBytes;
+        }
+    }
+}
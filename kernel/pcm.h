@@ -0,0 +1,36 @@
+#ifndef _PCM_H_
+#define _PCM_H_
+
+#include "stdint.h"
+
+// Sample format conversion into what the mixer works with: interleaved
+// 16-bit signed stereo.
+namespace PCM
+{
+    constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+    constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+
+    struct Format
+    {
+        uint16_t encoding; // WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+        uint16_t channels;
+        uint16_t bits;
+        uint16_t frameBytes; // block align: bytes per frame over all channels
+
+        // Data that can be handed to the hardware as is
+        bool isNative() const
+        {
+            return encoding == WAVE_FORMAT_PCM && channels == 2 && bits == 16 && frameBytes == 4;
+        }
+    };
+
+    // Fills `format` from WAV fmt chunk fields, false if we can't convert it
+    extern bool describe(uint16_t formatTag, uint16_t channels, uint16_t bits, uint16_t blockAlign, Format &format);
+
+    // Converts `frames` frames at src into 16-bit stereo at dst in a single
+    // pass. Mono is duplicated into both channels, channels past the second
+    // are dropped. src must be word aligned.
+    extern void toStereo16(const Format &format, const void *src, int16_t *dst, uint32_t frames);
+}
+
+#endif
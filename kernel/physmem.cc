@@ -40,6 +40,18 @@ namespace PhysMem {
         return p;
     }
 
+    uint32_t reserve(uint32_t size) {
+        LockGuard g{lock};
+
+        size = frameup(size);
+        if (limit - avail < size) {
+            Debug::panic("can't reserve %d bytes",size);
+        }
+        // off the top, alloc_frame works its way up from the bottom
+        limit -= size;
+        return limit;
+    }
+
     void dealloc_frame(uint32_t p) {
         LockGuard g{lock};
 
@@ -26,6 +26,11 @@ namespace PhysMem {
 
     uint32_t alloc_frame();
 
+    // Takes a contiguous, frame aligned range off the top of memory that
+    // alloc_frame will never hand out. For pools that need physically
+    // contiguous memory.
+    uint32_t reserve(uint32_t size);
+
     void dealloc_frame(uint32_t);
 }
 
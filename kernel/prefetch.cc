@@ -0,0 +1,128 @@
+#include "prefetch.h"
+#include "process.h"
+#include "machine.h"
+
+PrefetchFile::PrefetchFile(Shared<File> file, uint32_t limit) : file(file), cancel(Shared<Cancel>::make()), offset(file->getOffset())
+{
+    auto cancel = this->cancel;
+    auto own = file->reopen();
+    auto source = own == nullptr ? file : own;
+    // room for every chunk and the end, so put() never blocks
+    chunks = stream<Chunk>(Process::kernelProcess, CHUNKS + 1, [source, limit, cancel](Shared<BoundedBuffer<Chunk>> out)
+                           {
+        uint32_t left = limit;
+        while (left > 0)
+        {
+            cancel->room.down();
+            if (cancel->cancelled)
+            {
+                break;
+            }
+            uint32_t n = left < CHUNK_BYTES ? left : CHUNK_BYTES;
+            auto data = new uint8_t[n];
+            auto cnt = source->read(data, n);
+            if (cnt <= 0)
+            {
+                delete[] data;
+                break;
+            }
+            left -= cnt;
+            cancel->queued.add_fetch(1);
+            out->put(Chunk{data, (uint32_t)cnt});
+            cancel->bytes.add_fetch(cnt);
+        }
+        cancel->queued.add_fetch(1);
+        out->put(Chunk{nullptr, 0});
+        cancel->ended = true;
+
+        // stay around until the consumer is gone, then drop what it left
+        while (!cancel->cancelled)
+        {
+            cancel->room.down();
+        }
+        while (cancel->queued > 0)
+        {
+            delete[] out->get().data;
+            cancel->queued.add_fetch(-1);
+        } });
+}
+
+PrefetchFile::~PrefetchFile()
+{
+    // the reader does the rest, here may be the mixer
+    delete[] current.data;
+    cancel->cancelled = true;
+    cancel->room.up();
+}
+
+bool PrefetchFile::next()
+{
+    if (pos < current.bytes)
+    {
+        return true;
+    }
+    if (eof)
+    {
+        return false;
+    }
+    delete[] current.data;
+    current = chunks->get();
+    cancel->queued.add_fetch(-1);
+    cancel->bytes.add_fetch(-(int32_t)current.bytes);
+    pos = 0;
+    if (current.bytes == 0)
+    {
+        eof = true;
+        return false;
+    }
+    cancel->room.up();
+    return true;
+}
+
+uint32_t PrefetchFile::ready()
+{
+    if (eof || cancel->ended)
+    {
+        return TO_END;
+    }
+    int32_t queued = cancel->bytes.get();
+    return (current.bytes - pos) + (queued > 0 ? queued : 0);
+}
+
+ssize_t PrefetchFile::read(void *buffer, size_t n)
+{
+    auto dst = (uint8_t *)buffer;
+    size_t done = 0;
+    while (done < n && next())
+    {
+        uint32_t cnt = current.bytes - pos;
+        if (cnt > n - done)
+        {
+            cnt = n - done;
+        }
+        memcpy(dst + done, current.data + pos, cnt);
+        pos += cnt;
+        done += cnt;
+    }
+    offset += done;
+    return done;
+}
+
+off_t PrefetchFile::seek(off_t to)
+{
+    if (to < offset)
+    {
+        return -1;
+    }
+    while (offset < to && next())
+    {
+        uint32_t cnt = current.bytes - pos;
+        if ((off_t)cnt > to - offset)
+        {
+            cnt = to - offset;
+        }
+        pos += cnt;
+        offset += cnt;
+    }
+    return offset;
+}
@@ -0,0 +1,81 @@
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include "file.h"
+#include "bb.h"
+#include "semaphore.h"
+
+// Reads a file ahead of whoever consumes it. A kernel thread (see stream()
+// in bb.h) pulls CHUNK_BYTES at a time from the underlying file and keeps
+// up to CHUNKS of them queued, so as long as the disk keeps up a read() is
+// just a copy out of memory. When it doesn't, read() waits for it.
+//
+// Audio streams read their source through one of these, which takes the
+// disk off the mixer's path: the mixer asks ready() first and never reads
+// more than is already queued, so refilling a period never waits for IDE.
+// What's missing is made up with silence and read a period later.
+// Only forward seeks work (they skip data). The reader has a handle of
+// its own on the file (File::reopen()), so the process can go on using
+// its descriptor.
+class PrefetchFile : public File
+{
+public:
+    constexpr static uint32_t CHUNK_BYTES = 16384;
+    constexpr static uint32_t CHUNKS = 8;
+    constexpr static uint32_t TO_END = ~uint32_t(0);
+
+    struct Chunk
+    {
+        uint8_t *data;
+        uint32_t bytes; // 0 -> nothing more is coming
+    };
+
+    // Between the reader and the consumer. The reader takes room for a
+    // chunk before reading it and the consumer gives it back, so the queue
+    // itself never fills up. When the consumer goes away it only sets
+    // `cancelled`; the reader frees whatever is still queued, so nothing
+    // ever waits for the disk on the consumer's side.
+    struct Cancel
+    {
+        Atomic<uint32_t> ref_count{0};
+        volatile bool cancelled = false;
+        Semaphore room{CHUNKS};
+        Atomic<uint32_t> queued{0}; // chunks in the queue, the end included
+        // counted once they are in the queue, so the consumer can get() that
+        // much without waiting; it may briefly go negative
+        Atomic<int32_t> bytes{0};
+        volatile bool ended = false; // the end is in the queue too
+    };
+
+private:
+    Shared<File> file;
+    Shared<BoundedBuffer<Chunk>> chunks;
+    Shared<Cancel> cancel;
+    Chunk current{nullptr, 0};
+    uint32_t pos = 0;
+    bool eof = false;
+    off_t offset;
+
+    // makes sure `current` has bytes left, false at the end
+    bool next();
+
+public:
+    // Prefetches at most `limit` bytes from the file's current offset
+    PrefetchFile(Shared<File> file, uint32_t limit);
+    ~PrefetchFile();
+
+    // Bytes read() can hand out without waiting for the disk, TO_END once
+    // the rest of the file is queued
+    uint32_t ready();
+
+    bool isU8250() override { return false; }
+    bool isFile() override { return true; }
+    bool isDirectory() override { return false; }
+    off_t size() override { return file->size(); }
+    off_t seek(off_t offset) override;
+    off_t getOffset() override { return offset; }
+    ssize_t read(void *buffer, size_t n) override;
+    ssize_t write(void *buffer, size_t n) override { return -1; }
+};
+
+#endif
@@ -4,22 +4,17 @@
 #include "vmm.h"
 #include "pit.h"
 #include "libk.h"
+#include "audiodev.h"
 
 // id encoding
 //   upper bit -> sign
 //   3 bits -> kind
 //   28 bits -> index
-#define AC97_NAM_IO_VARIABLE_SAMPLE_RATE_FRONT_DAC 0x2C
-#define AC97_NAM_IO_VARIABLE_SAMPLE_RATE_SURR_DAC 0x2E
-#define AC97_NAM_IO_VARIABLE_SAMPLE_RATE_LFE_DAC 0x30
-#define AC97_NAM_IO_VARIABLE_SAMPLE_RATE_LR_ADC 0x32
-
 constexpr static uint32_t FL = 0x00000000;
 constexpr static uint32_t PROC = 0x10000000;
 constexpr static uint32_t SEM = 0x20000000;
+constexpr static uint32_t STRM = 0x30000000;
 constexpr static uint32_t INDEX_MASK = 0x0FFFFFFF;
-constexpr uint32_t BUFFER_SIZE = 131070; // 128 KB per buffer
-constexpr uint32_t NUM_BUFFERS = 32;
 
 Shared<Process> Process::kernelProcess = Shared<Process>::make(true);
 
@@ -38,8 +33,37 @@ Process::Process(bool isInit)
 	}
 }
 
+// Gives up a handle; a stream nobody has a handle to stops. Waiting for
+// the mixer is for callers that may block, teardown may not.
+static void release(Shared<AudioStream> stream, bool wait)
+{
+	if (stream->handles.add_fetch(-1) != 0)
+	{
+		return;
+	}
+	if (wait)
+	{
+		Audio::stop(stream);
+	}
+	else
+	{
+		Audio::cancel(stream);
+	}
+}
+
 Process::~Process()
 {
+	for (auto i = 0; i < NSTREAM; i++)
+	{
+		if (streams[i] != nullptr)
+		{
+			release(streams[i], false);
+		}
+	}
+	if (mappedRing != nullptr)
+	{
+		mappedRing->close();
+	}
 	gheith::delete_pd(pd);
 }
 
@@ -78,104 +102,63 @@ void clear_memory(uint32_t memory, uint32_t length)
 	}
 }
 
-void ac97_set_sample_rate(uint16_t sample_rate)
-{
-	// check if variable sample rate feature is present
-	using namespace AC97;
-	// Debug::printf("sample rate = %d\n", sample_rate);
-	// set same variable rate on all outputs
-	outw(BAR0 + AC97_NAM_IO_VARIABLE_SAMPLE_RATE_FRONT_DAC, sample_rate);
-	outw(BAR0 + AC97_NAM_IO_VARIABLE_SAMPLE_RATE_SURR_DAC, sample_rate);
-	outw(BAR0 + AC97_NAM_IO_VARIABLE_SAMPLE_RATE_LFE_DAC, sample_rate);
-	outw(BAR0 + AC97_NAM_IO_VARIABLE_SAMPLE_RATE_LR_ADC, sample_rate);
-
-	// Debug::printf("sample rate register = %u\n", inw(BAR0 + AC97_NAM_IO_VARIABLE_SAMPLE_RATE_FRONT_DAC));
-}
-
-void Process::findWavHDR(Shared<File> file, WAVHeader *wavhdr)
+int Process::newSemaphore(uint32_t init)
 {
-	file->read(wavhdr, 16);
-
-	while (wavhdr->fmt[0] != 'f' || wavhdr->fmt[1] != 'm' || wavhdr->fmt[2] != 't' || wavhdr->fmt[3] != ' ')
-	{
-		file->read(((char *)wavhdr) + 16, 4);
-		file->seek(file->getOffset() + wavhdr->fmt_length);
-		file->read(((char *)wavhdr) + 12, 4);
-	}
-
-	file->read(((char *)wavhdr) + 16, 4);
-	file->read(((char *)wavhdr) + 20, wavhdr->fmt_length + 4);
+	LockGuard<BlockingLock> lock{mutex};
 
-	while (wavhdr->data[0] != 'd' || wavhdr->data[1] != 'a' || wavhdr->data[2] != 't' || wavhdr->data[3] != 'a')
+	for (int i = 0; i < NSEM; i++)
 	{
-		file->read(((char *)wavhdr) + 40, 4);
-		file->seek(file->getOffset() + wavhdr->data_size);
-		file->read(((char *)wavhdr) + 36, 4);
+		auto p = sems[i];
+		if (p == nullptr)
+		{
+			sems[i] = Shared<Semaphore>::make(init);
+			return SEM | (i & INDEX_MASK);
+		}
 	}
-	// Debug::printf("should be data %s\n", wavhdr->data);
-	file->read(((char *)wavhdr) + 40, 4);
+	return -1;
 }
 
-void Process::fillBuffers(Shared<File> file, uint32_t sampleRate, bool last, uint32_t data_size, uint32_t totalSamples)
+Shared<Semaphore> Process::getSemaphore(int id)
 {
-	// Debug::printf("Filling buffers...\n");
-
-	uint32_t num_buffers = last ? data_size / BUFFER_SIZE : 32;
-
-	outl(AC97::BAR1 + 0x00, (uint32_t)(AC97::audio_buffers));		// Set the base address for Buffer Descriptor List
-	outb(AC97::BAR1 + 0x05, (uint8_t)num_buffers + (last ? 0 : -1)); // set number of descriptor entries
-
-	for (uint32_t i = 0; i < num_buffers; i++)
-	{
-		AC97::audio_buffers[i].length = 0xFFFE;
-		file->read((char *)AC97::audio_buffers[i].pointer, BUFFER_SIZE);
-		data_size -= BUFFER_SIZE;
-		totalSamples -= 0xFFFF;
-	}
-	if (last)
-	{
-		AC97::audio_buffers[num_buffers].length = (totalSamples - 1);
-		file->read((char *)AC97::audio_buffers[num_buffers].pointer, data_size);
-	}
-	// Debug::printf("...Buffers filled!!\n");
+	LockGuard<BlockingLock> g{mutex};
 
-	ac97_set_sample_rate(sampleRate);
-	outl(AC97::BAR1 + 0xB, 0x2);
-	while (inl(AC97::BAR1 + 0xB) == 0x2)
+	int idx = id & INDEX_MASK;
+	if ((idx >= NSEM) || ((id & 0xF0000000) != SEM))
 	{
-		// Debug::printf("hello");
-		iAmStuckInALoop(true);
+		return Shared<Semaphore>{};
 	}
-
-	return;
+	return sems[idx];
 }
 
-int Process::newSemaphore(uint32_t init)
+int Process::newStream(Shared<AudioStream> stream)
 {
 	LockGuard<BlockingLock> lock{mutex};
 
-	for (int i = 0; i < NSEM; i++)
+	for (int i = 0; i < NSTREAM; i++)
 	{
-		auto p = sems[i];
+		auto p = streams[i];
 		if (p == nullptr)
 		{
-			sems[i] = Shared<Semaphore>::make(init);
-			return SEM | (i & INDEX_MASK);
+			stream->handles.add_fetch(1);
+			streams[i] = stream;
+			return STRM | (i & INDEX_MASK);
 		}
 	}
+	// nobody could ever stop it
+	Audio::cancel(stream);
 	return -1;
 }
 
-Shared<Semaphore> Process::getSemaphore(int id)
+Shared<AudioStream> Process::getStream(int id)
 {
 	LockGuard<BlockingLock> g{mutex};
 
-	int idx = id & INDEX_MASK;
-	if ((idx >= NSEM) || ((id & 0xF0000000) != SEM))
+	int idx = getStreamIndex(id);
+	if (idx < 0)
 	{
-		return Shared<Semaphore>{};
+		return Shared<AudioStream>{};
 	}
-	return sems[idx];
+	return streams[idx];
 }
 
 void Process::clear_private()
@@ -185,6 +168,61 @@ void Process::clear_private()
 	LockGuard<BlockingLock> g{mutex};
 
 	delete_private(pd);
+
+	// the mapping went with the rest of the address space
+	if (mappedRing != nullptr)
+	{
+		mappedRing->close();
+		mappedRing = nullptr;
+	}
+}
+
+int Process::mapAudio()
+{
+	auto ring = Shared<AudioRing>::make(AudioDevFile::RATE);
+	if (ring->isNull())
+	{
+		return -1;
+	}
+	{
+		LockGuard<BlockingLock> g{mutex};
+		if (mappedRing != nullptr)
+		{
+			return -1;
+		}
+		for (uint32_t i = 0; i < ring->pages(); i++)
+		{
+			gheith::map_device(pd, AUDIO_MAP_VA + i * PhysMem::FRAME_SIZE, ring->phys() + i * PhysMem::FRAME_SIZE);
+		}
+		mappedRing = ring;
+	}
+
+	auto stream = Audio::play(ring);
+	int id = (stream == nullptr) ? -1 : newStream(stream);
+	if (id < 0)
+	{
+		if (stream != nullptr)
+		{
+			Audio::stop(stream);
+		}
+		unmapAudio();
+	}
+	return id;
+}
+
+void Process::unmapAudio()
+{
+	LockGuard<BlockingLock> g{mutex};
+	if (mappedRing == nullptr)
+	{
+		return;
+	}
+	for (uint32_t i = 0; i < mappedRing->pages(); i++)
+	{
+		gheith::unmap(pd, AUDIO_MAP_VA + i * PhysMem::FRAME_SIZE);
+	}
+	mappedRing->close();
+	mappedRing = nullptr;
 }
 
 Shared<Process> Process::fork(int &id)
@@ -236,6 +274,8 @@ Shared<Process> Process::fork(int &id)
 			auto parent_pte = parent_pt[pti];
 			if ((parent_pte & 1) == 0)
 				continue;
+			if (parent_pte & gheith::PTE_DEVICE)
+				continue; // device mappings stay with the process that made them
 			auto parent_frame = parent_pte & 0xFFFFF000;
 			// Debug::printf("fork: copying %x\n",(pdi << 22) | (pti << 12));
 			auto child_frame = PhysMem::alloc_frame();
@@ -258,6 +298,16 @@ Shared<Process> Process::fork(int &id)
 	{
 		child->files[i] = files[i];
 	}
+	for (auto i = 0; i < NSTREAM; i++)
+	{
+		if (streams[i] != nullptr)
+		{
+			streams[i]->handles.add_fetch(1);
+		}
+		child->streams[i] = streams[i];
+	}
+
+	child->audioPeriod = audioPeriod;
 
 	children[index] = child->output;
 	id = PROC | index;
@@ -297,6 +347,17 @@ int Process::getFileIndex(int id)
 	return index;
 }
 
+int Process::getStreamIndex(int id)
+{
+	int kind = id & 0xF0000000;
+	int index = id & INDEX_MASK;
+	if (kind != STRM)
+		return -1;
+	if (index >= NSTREAM)
+		return -1;
+	return index;
+}
+
 int Process::close(int id)
 {
 	auto index = getSemaphoreIndex(id);
@@ -325,6 +386,24 @@ int Process::close(int id)
 		return 0;
 	}
 
+	index = getStreamIndex(id);
+
+	if (index != -1)
+	{
+		auto e = streams[index];
+		if (e == nullptr)
+		{
+			return -1;
+		}
+		streams[index] = nullptr;
+		if (e->ring != nullptr && e->ring == mappedRing)
+		{
+			unmapAudio();
+		}
+		release(e, true);
+		return 0;
+	}
+
 	index = getFileIndex(id);
 
 	if (index != -1)
@@ -11,42 +11,26 @@
 #include "u8250.h"
 #include "shared.h"
 #include "pci.h"
-
-struct WAVHeader
-{
-    unsigned char riff[4];
-    uint32_t file_size;
-    unsigned char magic0;
-    unsigned char magic1;
-    unsigned char magic2;
-    unsigned char magic3;
-    unsigned char fmt[4];
-    uint32_t fmt_length;
-    uint16_t format_type;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t sample_rate_eq;
-    uint16_t garb;
-    uint16_t bitsPerSample;
-    unsigned char data[4];
-    uint32_t data_size;
-};
+#include "audio.h"
 
 class Process
 {
     constexpr static int NSEM = 10;
     constexpr static int NCHILD = 10;
     constexpr static int NFILE = 10;
-    constexpr static int NBUFFERS = 32;
+    constexpr static int NSTREAM = 10;
 
     Shared<File> files[NFILE]{};
     Shared<Semaphore> sems[NSEM]{};
     Shared<Future<uint32_t>> children[NCHILD]{};
+    Shared<AudioStream> streams[NSTREAM]{};
+    Shared<AudioRing> mappedRing{};
     BlockingLock mutex{};
 
     int getChildIndex(int id);
     int getSemaphoreIndex(int id);
     int getFileIndex(int id);
+    int getStreamIndex(int id);
 
     Atomic<uint32_t> ref_count{0};
 
@@ -55,19 +39,31 @@ public:
     uint32_t *pd = gheith::make_pd();
     static Shared<Process> kernelProcess;
 
+    // period settings for the audio streams this process starts
+    Audio::Period audioPeriod = Audio::NO_PERIOD;
+
     Process(bool isInit);
     virtual ~Process();
 
     Shared<Process> fork(int &id);
     void clear_private();
 
-    void findWavHDR(Shared<File> file, WAVHeader *wavhdr);
-    void fillBuffers(Shared<File> file, uint32_t sampleRate, bool last, uint32_t data_size, uint32_t totalSamples);
-
     int newSemaphore(uint32_t init);
 
     Shared<Semaphore> getSemaphore(int id);
 
+    int newStream(Shared<AudioStream> stream);
+
+    Shared<AudioStream> getStream(int id);
+
+    // Where a mapped audio ring shows up: its control page, then the samples
+    constexpr static uint32_t AUDIO_MAP_VA = 0xF0000000;
+
+    // Maps a new audio ring at AUDIO_MAP_VA and starts playing it, returns
+    // the stream handle. One mapping per process.
+    int mapAudio();
+    void unmapAudio();
+
     Shared<File> getFile(int fd)
     {
         auto i = getFileIndex(fd);
@@ -0,0 +1,69 @@
+#include "resample.h"
+#include "machine.h"
+
+// 16.16 step without 64-bit division (we don't link libgcc)
+static uint32_t ratio(uint32_t in, uint32_t out)
+{
+    return ((in / out) << 16) + (((in % out) << 16) / out);
+}
+
+Resampler::Resampler(uint32_t inRate, uint32_t outRate) : step(ratio(inRate, outRate)),
+                                                         window(new int16_t[WINDOW_FRAMES * 2]),
+                                                         inRate(inRate), outRate(outRate)
+{
+}
+
+Resampler::~Resampler()
+{
+    delete[] window;
+}
+
+// Emits frames while both neighbours of the read position are in the window
+uint32_t Resampler::interpolate(int16_t *out, uint32_t frames)
+{
+    uint32_t n = 0;
+    uint32_t p = pos;
+    const int16_t *w = window;
+    const uint32_t last = avail;
+
+    while (n < frames)
+    {
+        uint32_t i = p >> 16;
+        if (i + 1 >= last)
+        {
+            break;
+        }
+        int32_t frac = (p & 0xFFFF) >> 1;
+        const int16_t *a = w + 2 * i;
+        int32_t l = a[0] + (((a[2] - a[0]) * frac) >> 15);
+        int32_t r = a[1] + (((a[3] - a[1]) * frac) >> 15);
+        out[0] = (int16_t)l;
+        out[1] = (int16_t)r;
+        out += 2;
+        p += step;
+        n++;
+    }
+    pos = p;
+    return n;
+}
+
+// Drops consumed frames, keeping the left neighbour of the read position
+void Resampler::compact()
+{
+    uint32_t keep = pos >> 16;
+    if (keep > avail)
+    {
+        keep = avail;
+    }
+    if (keep == 0)
+    {
+        return;
+    }
+    uint32_t *w = (uint32_t *)window; // one stereo frame per word
+    for (uint32_t i = keep; i < avail; i++)
+    {
+        w[i - keep] = w[i];
+    }
+    avail -= keep;
+    pos -= keep << 16;
+}
@@ -0,0 +1,62 @@
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include "stdint.h"
+
+// Streaming linear-interpolation sample rate converter for 16-bit stereo.
+//
+// Positions are kept in 16.16 fixed point relative to the start of an
+// internal input window. The window always keeps the frame to the left of
+// the current position so interpolation is continuous across refills.
+// Interpolation weights are Q15 so every product fits in 32 bits.
+class Resampler
+{
+public:
+    constexpr static uint32_t WINDOW_FRAMES = 1024;
+
+private:
+    const uint32_t step; // input frames per output frame, 16.16
+    uint32_t pos = 0;    // read position in the window, 16.16
+    uint32_t avail = 0;  // frames in the window
+    bool ended = false;
+    int16_t *window;
+
+public:
+    const uint32_t inRate;
+    const uint32_t outRate;
+
+    Resampler(uint32_t inRate, uint32_t outRate);
+    ~Resampler();
+
+    Resampler(const Resampler &) = delete;
+
+    // Produces up to `frames` output frames. `pull(int16_t* buf, uint32_t n)`
+    // supplies up to n input frames and returns how many it wrote, 0 at the end.
+    template <typename Pull>
+    uint32_t run(int16_t *out, uint32_t frames, Pull pull)
+    {
+        uint32_t produced = 0;
+        while (produced < frames)
+        {
+            produced += interpolate(out + 2 * produced, frames - produced);
+            if (produced == frames || ended)
+            {
+                break;
+            }
+            compact();
+            uint32_t n = pull(window + 2 * avail, WINDOW_FRAMES - avail);
+            if (n == 0)
+            {
+                ended = true;
+            }
+            avail += n;
+        }
+        return produced;
+    }
+
+private:
+    uint32_t interpolate(int16_t *out, uint32_t frames);
+    void compact();
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "soundcache.h"
+#include "audio.h"
+#include "blocking_lock.h"
+#include "machine.h"
+
+namespace SoundCache
+{
+    struct Entry
+    {
+        Shared<Clip> clip;
+        uint64_t lastUse;
+    };
+
+    static BlockingLock lock{};
+    static Entry entries[MAX_CLIPS]{};
+    static uint64_t uses = 0;
+    static uint32_t bytes = 0;
+    static uint32_t hits = 0;
+    static uint32_t misses = 0;
+
+    static inline uint32_t size(Shared<Clip> clip)
+    {
+        return clip->frames * 4;
+    }
+
+    Shared<Clip> find(uint32_t number)
+    {
+        LockGuard<BlockingLock> g{lock};
+        for (uint32_t i = 0; i < MAX_CLIPS; i++)
+        {
+            auto clip = entries[i].clip;
+            if (clip != nullptr && clip->number == number)
+            {
+                entries[i].lastUse = ++uses;
+                hits++;
+                return clip;
+            }
+        }
+        misses++;
+        return Shared<Clip>{};
+    }
+
+    // Drops least recently used clips until `need` more bytes fit in a
+    // free slot, returns the slot. Must hold the lock.
+    static uint32_t makeRoom(uint32_t need)
+    {
+        while (true)
+        {
+            uint32_t oldest = MAX_CLIPS;
+            uint32_t free = MAX_CLIPS;
+            for (uint32_t i = 0; i < MAX_CLIPS; i++)
+            {
+                if (entries[i].clip == nullptr)
+                {
+                    free = i;
+                }
+                else if (oldest == MAX_CLIPS || entries[i].lastUse < entries[oldest].lastUse)
+                {
+                    oldest = i;
+                }
+            }
+            if (free != MAX_CLIPS && bytes + need <= CACHE_BYTES)
+            {
+                return free;
+            }
+            // streams still playing the clip keep it alive
+            bytes -= size(entries[oldest].clip);
+            entries[oldest].clip = nullptr;
+        }
+    }
+
+    // What a stream that hasn't been read from decodes to according to its
+    // header, 0 if the header doesn't say
+    static uint32_t expectedFrames(Shared<AudioStream> stream)
+    {
+        if (stream->flac != nullptr)
+        {
+            return stream->flac->totalFrames;
+        }
+        if (stream->decoder != nullptr)
+        {
+            // the last block may be short
+            auto d = stream->decoder;
+            uint32_t blocks = (stream->bytes + d->blockBytes - 1) / d->blockBytes;
+            return blocks * d->framesPerBlock;
+        }
+        return stream->bytes / stream->format.frameBytes;
+    }
+
+    Shared<Clip> load(uint32_t number, Shared<AudioStream> stream)
+    {
+        // decoded straight into the clip, no bigger than it has to be
+        uint32_t expect = expectedFrames(stream);
+        if (expect == 0 || expect > MAX_CLIP_FRAMES)
+        {
+            return Shared<Clip>{};
+        }
+        auto samples = new int16_t[expect * 2];
+        uint32_t frames = stream->readFrames(samples, expect);
+        int16_t extra[2];
+        if (frames == 0 || stream->readFrames(extra, 1) != 0)
+        {
+            // more than the header said, or nothing at all
+            delete[] samples;
+            return Shared<Clip>{};
+        }
+
+        auto clip = Shared<Clip>::make(number, stream->sampleRate, frames, samples);
+
+        LockGuard<BlockingLock> g{lock};
+        for (uint32_t i = 0; i < MAX_CLIPS; i++)
+        {
+            // someone else decoded it at the same time
+            if (entries[i].clip != nullptr && entries[i].clip->number == number)
+            {
+                return entries[i].clip;
+            }
+        }
+        uint32_t i = makeRoom(size(clip));
+        entries[i].clip = clip;
+        entries[i].lastUse = ++uses;
+        bytes += size(clip);
+        return clip;
+    }
+
+    void stats(Stats &out)
+    {
+        LockGuard<BlockingLock> g{lock};
+        out.hits = hits;
+        out.misses = misses;
+        out.clips = 0;
+        for (uint32_t i = 0; i < MAX_CLIPS; i++)
+        {
+            if (entries[i].clip != nullptr)
+            {
+                out.clips++;
+            }
+        }
+        out.bytes = bytes;
+    }
+}
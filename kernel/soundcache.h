@@ -0,0 +1,56 @@
+#ifndef _SOUNDCACHE_H_
+#define _SOUNDCACHE_H_
+
+#include "stdint.h"
+#include "atomic.h"
+#include "shared.h"
+
+class AudioStream;
+
+// Decoded sound cache
+//
+// Short clips (UI sounds, alerts) get played over and over. Files up to
+// MAX_FILE_BYTES are decoded once, whatever their format, and kept as
+// 16-bit stereo at their own rate, keyed by i-number. Playing one again
+// skips the header, the decoder and the disk. The file system is read-only
+// so an entry never goes stale; the least recently played clips are
+// dropped to stay under CACHE_BYTES.
+namespace SoundCache
+{
+    constexpr uint32_t MAX_FILE_BYTES = 64 * 1024;
+    constexpr uint32_t MAX_CLIP_FRAMES = 128 * 1024; // 512KB decoded
+    constexpr uint32_t CACHE_BYTES = 1024 * 1024;
+    constexpr uint32_t MAX_CLIPS = 32;
+
+    struct Clip
+    {
+        Atomic<uint32_t> ref_count{0};
+        uint32_t number;
+        uint32_t rate;
+        uint32_t frames;
+        int16_t *samples;
+
+        Clip(uint32_t number, uint32_t rate, uint32_t frames, int16_t *samples) : number(number), rate(rate), frames(frames), samples(samples) {}
+        ~Clip() { delete[] samples; }
+    };
+
+    struct Stats
+    {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t clips;
+        uint32_t bytes;
+    };
+
+    // The clip for i-number `number`, null (and a miss) if it isn't cached
+    extern Shared<Clip> find(uint32_t number);
+
+    // Decodes `stream` (which must not have been read from or played)
+    // and caches it, sized from its header. Null if that says more than
+    // MAX_CLIP_FRAMES or doesn't say, the stream is used up either way.
+    extern Shared<Clip> load(uint32_t number, Shared<AudioStream> stream);
+
+    extern void stats(Stats &out);
+}
+
+#endif
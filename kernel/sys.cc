@@ -13,8 +13,11 @@
 #include "shared.h"
 #include "kernel.h"
 #include "openfilestruct.h"
-#include "pci.h"
+#include "audiodev.h"
 #include "pit.h"
+#include "audio.h"
+#include "prefetch.h"
+#include "wav.h"
 
 int strlen(const char *string)
 {
@@ -133,6 +136,116 @@ int SYS::exec(const char *path,
     return -1;
 }
 
+// Parses the header at the file's offset and sets up a stream for its
+// data, which doesn't play yet. With `prefetch` the data is read ahead by
+// its own thread and the mixer only copies.
+static Shared<AudioStream> openAudio(Shared<File> file, bool prefetch)
+{
+    using namespace gheith;
+
+    // FLAC files carry their own framing, everything else has to be WAV
+    char magic[4];
+    auto start = file->getOffset();
+    auto cnt = file->read(magic, 4);
+    file->seek(start);
+    if (cnt == 4 && magic[0] == 'f' && magic[1] == 'L' && magic[2] == 'a' && magic[3] == 'C')
+    {
+        auto ahead = prefetch ? new PrefetchFile(file, PrefetchFile::TO_END) : nullptr;
+        Shared<File> source = ahead != nullptr ? Shared<File>{ahead} : file;
+        auto flac = new FlacDecoder(source);
+        if (!flac->open())
+        {
+            Debug::printf("*** Unsupported FLAC stream.\n");
+            delete flac;
+            return Shared<AudioStream>{};
+        }
+        auto stream = Audio::open(file, flac);
+        if (stream != nullptr)
+        {
+            stream->ahead = ahead;
+        }
+        return stream;
+    }
+
+    WAV::Info wav;
+    if (!WAV::parse(file, wav))
+    {
+        Debug::printf("*** Trying to play a non-WAV audio file.\n");
+        return Shared<AudioStream>{};
+    }
+
+    PCM::Format format{wav.formatTag, wav.channels, wav.bitsPerSample, wav.blockAlign};
+    auto decoder = AdpcmDecoder::make(wav.formatTag, wav.channels, wav.blockAlign, wav.ext, wav.extBytes);
+    if (decoder == nullptr && !PCM::describe(wav.formatTag, wav.channels, wav.bitsPerSample, wav.blockAlign, format))
+    {
+        Debug::printf("*** Unsupported WAV format %d (%d channels, %d bits).\n", wav.formatTag, wav.channels, wav.bitsPerSample);
+        return Shared<AudioStream>{};
+    }
+
+    auto ahead = prefetch ? new PrefetchFile(file, wav.dataBytes) : nullptr;
+    Shared<File> source = ahead != nullptr ? Shared<File>{ahead} : file;
+    auto stream = Audio::open(source, format, wav.sampleRate, wav.dataBytes, decoder);
+    if (stream != nullptr)
+    {
+        stream->ahead = ahead;
+    }
+    return stream;
+}
+
+// A stream for fd, ready to play. Small files go through the sound
+// cache, everything else is streamed.
+static Shared<AudioStream> loadAudio(int fd)
+{
+    using namespace gheith;
+
+    auto file = current()->process->getFile(fd);
+    if (file == nullptr || file->isU8250() || !file->isFile())
+    {
+        return Shared<AudioStream>{};
+    }
+
+    // clips are whole files, so only a play from the top can use one
+    auto number = file->inumber();
+    bool small = number != 0 && file->getOffset() == 0 && file->size() <= SoundCache::MAX_FILE_BYTES;
+    if (small)
+    {
+        auto clip = SoundCache::find(number);
+        if (clip != nullptr)
+        {
+            return Audio::open(clip);
+        }
+    }
+
+    auto start = file->getOffset();
+    auto stream = openAudio(file, !small);
+    if (stream == nullptr)
+    {
+        return stream;
+    }
+    if (small)
+    {
+        auto clip = SoundCache::load(number, stream);
+        if (clip != nullptr)
+        {
+            return Audio::open(clip);
+        }
+        // it decodes to more than the cache takes, stream it after all
+        file->seek(start);
+        stream = openAudio(file, true);
+    }
+    return stream;
+}
+
+static Shared<AudioStream> startAudio(int fd)
+{
+    auto stream = loadAudio(fd);
+    if (stream == nullptr)
+    {
+        return stream;
+    }
+    return Audio::play(stream);
+}
+
 extern "C" int sysHandler(uint32_t eax, uint32_t *frame)
 {
     using namespace gheith;
@@ -281,6 +394,25 @@ extern "C" int sysHandler(uint32_t eax, uint32_t *frame)
         }
         // //Debug::printf("filename = %s\n", filename);
         //  checks for valid string here
+        if (K::streq(filename, AudioDevFile::PATH))
+        {
+            auto dev = new AudioDevFile();
+            Shared<File> file{dev};
+            if (!dev->isReady())
+            {
+                return -1;
+            }
+            return current()->process->setFile(file);
+        }
+        if (K::streq(filename, AudioInFile::PATH))
+        {
+            auto file = AudioInFile::open();
+            if (file == nullptr)
+            {
+                return -1;
+            }
+            return current()->process->setFile(file);
+        }
         Shared<Node> node = root_fs->find(root_fs->root, filename);
         if (node == nullptr)
         {
@@ -361,74 +493,218 @@ extern "C" int sysHandler(uint32_t eax, uint32_t *frame)
     case 14: /*play_audio*/
     {
         // Debug::printf("Inside play_audio sys call.\n");
-        int fd = (int)userEsp[1];
-        auto file = gheith::current()->process->getFile(fd);
-        if (file == nullptr || file->isU8250())
+        auto stream = startAudio((int)userEsp[1]);
+        if (stream == nullptr)
         {
             return -1;
         }
+        Debug::printf("Started playing audio.\n");
+        stream->wait();
+        Debug::printf("Finished playing audio.\n");
 
-        WAVHeader *wavhdr = new WAVHeader;
-        current()->process->findWavHDR(file, wavhdr);
-
-        if (wavhdr->magic0 != 'W' || wavhdr->magic1 != 'A' || wavhdr->magic2 != 'V' || wavhdr->magic3 != 'E')
+        return 1;
+    }
+    case 15: /* play_audio_async */
+    {
+        auto stream = startAudio((int)userEsp[1]);
+        if (stream == nullptr)
         {
-            Debug::printf("*** Trying to play a non-WAV audio file.\n");
             return -1;
         }
-
-        // Debug::printf("Sample Rate = %d\n", wavhdr->sample_rate);
-        // Debug::printf("Data_size = %d\n", wavhdr->data_size);
-        // Debug::printf("num channels = %d\n", wavhdr->num_channels);
-
-
-        // int num_buffers = wavhdr->data_size / 131070;
-        // Debug::printf("buffers neing read = %d\n", num_buffers);
-
-        uint32_t data_size = wavhdr->data_size;
-        uint32_t buffer_size = 131070;
-        uint32_t totalSamples = wavhdr->sample_rate * (wavhdr->bitsPerSample / 8);
-        totalSamples /= 2;
-        Debug::printf("Started playing audio.\n");
-
-        while (data_size > 0)
+        return current()->process->newStream(stream);
+    }
+    case 16: /* audio_wait */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        if (stream == nullptr)
         {
-            
-            uint32_t duration;
-            uint32_t jiffies;
-            if (data_size < (32 * buffer_size))
-            {
-                current()->process->fillBuffers(file, wavhdr->sample_rate, true, data_size, totalSamples);
-                duration = data_size / wavhdr->sample_rate_eq;
-                jiffies = (((data_size)) % wavhdr->sample_rate_eq);
-                jiffies *= 1000;
-                jiffies /= wavhdr->sample_rate_eq;
-                data_size = 0;
-                totalSamples = 0;
-            }
-            else
+            return -1;
+        }
+        return stream->wait();
+    }
+    case 17: /* audio_poll */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        return stream->finished ? 0 : 1;
+    }
+    case 18: /* audio_stop */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        Audio::stop(stream);
+        return 0;
+    }
+    case 19: /* audio_gain */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        uint32_t gain = userEsp[2];
+        if (stream == nullptr || gain > 0xFFFF)
+        {
+            return -1;
+        }
+        stream->gain = gain;
+        return 0;
+    }
+    case 20: /* audio_mmap */
+    {
+        uint32_t *out = (uint32_t *)userEsp[1];
+        if ((uint32_t)out < 0x80000000 || (uint32_t)out == kConfig.ioAPIC || (uint32_t)out == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        int id = current()->process->mapAudio();
+        if (id >= 0)
+        {
+            *out = Process::AUDIO_MAP_VA;
+        }
+        return id;
+    }
+    case 21: /* audio_mmap_wait */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        if (stream == nullptr || stream->ring == nullptr)
+        {
+            return -1;
+        }
+        return stream->ring->waitForSpace(userEsp[2]) ? 0 : -1;
+    }
+    case 22: /* audio_period */
+    {
+        Audio::Period period{userEsp[1], userEsp[2]};
+        if (!Audio::isValid(period))
+        {
+            return -1;
+        }
+        current()->process->audioPeriod = period;
+        return 0;
+    }
+    case 23: /* audio_position */
+    {
+        int id = (int)userEsp[1];
+        auto out = (Audio::Position *)userEsp[2];
+        if ((uint32_t)out < 0x80000000 || (uint32_t)out == kConfig.ioAPIC || (uint32_t)out == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        if (id < 0)
+        {
+            Audio::position(*out);
+            return 0;
+        }
+        auto stream = current()->process->getStream(id);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        Audio::position(stream, *out);
+        return 0;
+    }
+    case 24: /* audio_cache_stats */
+    {
+        auto out = (SoundCache::Stats *)userEsp[1];
+        if ((uint32_t)out < 0x80000000 || (uint32_t)out == kConfig.ioAPIC || (uint32_t)out == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        SoundCache::stats(*out);
+        return 0;
+    }
+    case 25: /* audio_enqueue */
+    {
+        int id = (int)userEsp[1];
+        auto track = loadAudio((int)userEsp[2]);
+        if (track == nullptr)
+        {
+            return -1;
+        }
+        if (id < 0)
+        {
+            auto stream = Audio::play(Shared<Playlist>::make(), track);
+            if (stream == nullptr)
             {
-                current()->process->fillBuffers(file, wavhdr->sample_rate, false, data_size, totalSamples);
-                duration = (32 * buffer_size) / wavhdr->sample_rate_eq;
-                jiffies = ((32 * buffer_size) % wavhdr->sample_rate_eq);
-                jiffies *= 1000;
-                jiffies /= wavhdr->sample_rate_eq;
-                data_size -= (32 * 131070);
-                totalSamples -= (0xFFFF * 32);
+                return -1;
             }
-            //set the play bit to 1
-            if (duration == (uint32_t)-1)
+            return current()->process->newStream(stream);
+        }
+        auto stream = current()->process->getStream(id);
+        if (stream == nullptr || stream->playlist == nullptr || !stream->playlist->add(track))
+        {
+            return -1;
+        }
+        return id;
+    }
+    case 26: /* audio_dsp */
+    {
+        auto stream = current()->process->getStream((int)userEsp[1]);
+        auto config = (const Dsp::Config *)userEsp[2];
+        if ((uint32_t)config < 0x80000000 || (uint32_t)config == kConfig.ioAPIC || (uint32_t)config == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        // the mixer swaps it in at its next period
+        delete stream->newDsp.exchange(new Dsp(*config));
+        return 0;
+    }
+    case 27: /* audio_stats */
+    {
+        struct Out
+        {
+            Audio::DeviceStats device;
+            Audio::StreamStats stream;
+        };
+        int id = (int)userEsp[1];
+        auto out = (Out *)userEsp[2];
+        if ((uint32_t)out < 0x80000000 || (uint32_t)out == kConfig.ioAPIC || (uint32_t)out == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        Shared<AudioStream> stream{};
+        if (id >= 0)
+        {
+            stream = current()->process->getStream(id);
+            if (stream == nullptr)
             {
                 return -1;
             }
-            // Debug::printf("duration = %d\n", duration);
-            outl(AC97::BAR0 + 0x02, 0x0000); // Master volume to max
-            // outl(AC97::BAR0 + 0x18, 0x0000); // Master volume to max
-            AC97::play(duration, jiffies);
         }
-        Debug::printf("Finished playing audio.\n");
-
-        return 1;
+        Audio::stats(stream, out->device, out->stream);
+        return 0;
+    }
+    case 28: /* audio_trace */
+    {
+        auto out = (Audio::TraceEntry *)userEsp[1];
+        if ((uint32_t)out < 0x80000000 || (uint32_t)out == kConfig.ioAPIC || (uint32_t)out == kConfig.localAPIC)
+        {
+            return -1;
+        }
+        return Audio::trace(out, userEsp[2]);
+    }
+    case 29: /* audio_play_at */
+    {
+        // the frame is a uint64_t, low half first
+        uint64_t at = userEsp[2] | ((uint64_t)userEsp[3] << 32);
+        auto stream = loadAudio((int)userEsp[1]);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        stream = Audio::play(stream, at);
+        if (stream == nullptr)
+        {
+            return -1;
+        }
+        return current()->process->newStream(stream);
     }
 
     default:
@@ -17,14 +17,29 @@ namespace gheith
 
     uint32_t *shared = nullptr;
 
+    // device register pages from VMM::mapDevice
+    constexpr uint32_t MAX_DEVICE_PAGES = 16;
+    static uint32_t devicePages[MAX_DEVICE_PAGES];
+    static uint32_t nDevicePages = 0;
+
+    static bool is_device(uint32_t va)
+    {
+        for (uint32_t i = 0; i < nDevicePages; i++)
+        {
+            if (devicePages[i] == va)
+                return true;
+        }
+        return false;
+    }
+
         bool is_special(uint32_t va)
     {
-        return (va < 0x80000000) || (va == kConfig.ioAPIC) || (va == kConfig.localAPIC);
+        return (va < 0x80000000) || (va == kConfig.ioAPIC) || (va == kConfig.localAPIC) || is_device(va);
     }
 
     void map(uint32_t *pd, uint32_t va, uint32_t pa)
     {
-        bool shared = (va < 0x80000000 || va == kConfig.ioAPIC || va == kConfig.localAPIC);
+        bool shared = is_special(va);
         int num = shared ? 3 : 7; //user bit set or not, dont let user touch kernel stuff
         auto pdi = va >> 22;
         auto pti = (va >> 12) & 0x3FF;
@@ -38,6 +53,13 @@ namespace gheith
         pt[pti] = pa | num;
     }
 
+    void map_device(uint32_t *pd, uint32_t va, uint32_t pa)
+    {
+        map(pd, va, pa);
+        auto pt = (uint32_t *)(pd[va >> 22] & 0xFFFFF000);
+        pt[(va >> 12) & 0x3FF] |= PTE_DEVICE;
+    }
+
     void unmap(uint32_t *pd, uint32_t va)
     {
         if (is_special(va)) {
@@ -54,7 +76,8 @@ namespace gheith
             return;
         auto pa = pte & 0xFFFFF000;
         pt[pti] = 0;
-        dealloc_frame(pa);
+        if ((pte & PTE_DEVICE) == 0)
+            dealloc_frame(pa);
         invlpg(va);
     }
 
@@ -70,7 +93,10 @@ namespace gheith
 
         map(pd, kConfig.ioAPIC, kConfig.ioAPIC);
         map(pd, kConfig.localAPIC, kConfig.localAPIC);
-        // map(pd, kCOnfig.ACpic)
+        for (uint32_t i = 0; i < nDevicePages; i++)
+        {
+            map_device(pd, devicePages[i], devicePages[i]);
+        }
 
         return pd;
     }
@@ -100,7 +126,8 @@ namespace gheith
                     continue;
                 pt[pti] = 0;
                 auto frame = pte & 0xFFFFF000;
-                dealloc_frame(frame);
+                if ((pte & PTE_DEVICE) == 0)
+                    dealloc_frame(frame);
                 invlpg(va);
             }
             if (!contains_special)
@@ -130,7 +157,7 @@ namespace gheith
                 if ((pte & 1) == 0)
                     continue;
                 auto frame = pte & 0xFFFFF000;
-                if (!is_special(va))
+                if (!is_special(va) && (pte & PTE_DEVICE) == 0)
                 {
                     dealloc_frame(frame);
                 }
@@ -156,6 +183,21 @@ namespace VMM
         }
     }
 
+    void mapDevice(uint32_t pa, uint32_t bytes)
+    {
+        using namespace gheith;
+        for (uint32_t va = PhysMem::framedown(pa); va < pa + bytes; va += FRAME_SIZE)
+        {
+            if (va < 0x80000000 || is_special(va))
+                continue;
+            if (nDevicePages == MAX_DEVICE_PAGES)
+                Debug::panic("VMM: too many device pages");
+            devicePages[nDevicePages++] = va;
+            // the kernel process predates this
+            map_device(Process::kernelProcess->pd, va, va);
+        }
+    }
+
     void per_core_init()
     {
         using namespace gheith;
@@ -178,7 +220,7 @@ extern "C" void vmm_pageFault(uintptr_t va_, uintptr_t *saveState)
 
     uint32_t va = PhysMem::framedown(va_);
 
-    if (va >= 0x80000000)
+    if (va >= 0x80000000 && !is_special(va))
     {
         auto pa = PhysMem::alloc_frame();
         map(me->process->pd, va, pa);
@@ -5,7 +5,13 @@
 
 namespace gheith
 {
+    // available-to-software PTE bit: the frame belongs to someone else
+    // (device memory), so tearing down the mapping must not free it
+    constexpr uint32_t PTE_DEVICE = 1 << 9;
+
     extern uint32_t *make_pd();
+    extern void map_device(uint32_t *pd, uint32_t va, uint32_t pa);
+    extern void unmap(uint32_t *pd, uint32_t va);
     extern void delete_pd(uint32_t *);
     extern void delete_private(uint32_t *);
 }
@@ -18,6 +24,11 @@ namespace VMM
 
     // Called on each core to do per-core initialization
     extern void per_core_init();
+
+    // Maps `bytes` of device registers at physical `pa` to the same address
+    // in every address space, kernel only, like the APICs. For MMIO above
+    // 0x80000000; call it at boot, before there are user processes.
+    extern void mapDevice(uint32_t pa, uint32_t bytes);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "wav.h"
+#include "blocking_lock.h"
+#include "machine.h"
+
+namespace WAV
+{
+    constexpr uint32_t WINDOW_BYTES = 4096;
+
+    // Read-only view of the file through a buffer, refilled only when a
+    // range outside of it is asked for
+    class Window
+    {
+        Shared<File> file;
+        uint8_t *buffer;
+        uint32_t start = 0;
+        uint32_t length = 0;
+
+    public:
+        Window(Shared<File> file) : file(file), buffer(new uint8_t[WINDOW_BYTES]) {}
+        ~Window() { delete[] buffer; }
+
+        Window(const Window &) = delete;
+
+        // n (<= WINDOW_BYTES) bytes at file offset `at`, null past the end
+        const uint8_t *at(uint32_t at, uint32_t n)
+        {
+            if (at < start || at + n > start + length)
+            {
+                if (file->seek(at) != at)
+                {
+                    return nullptr;
+                }
+                auto cnt = file->read(buffer, WINDOW_BYTES);
+                start = at;
+                length = cnt < 0 ? 0 : cnt;
+                if (n > length)
+                {
+                    return nullptr;
+                }
+            }
+            return buffer + (at - start);
+        }
+    };
+
+    static inline uint16_t u16(const uint8_t *p)
+    {
+        return p[0] | (p[1] << 8);
+    }
+
+    static inline uint32_t u32(const uint8_t *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static inline bool is(const uint8_t *p, const char *id)
+    {
+        return p[0] == id[0] && p[1] == id[1] && p[2] == id[2] && p[3] == id[3];
+    }
+
+    static bool parseFmt(const uint8_t *p, uint32_t size, Info &out)
+    {
+        if (size < 16)
+        {
+            return false;
+        }
+        out.formatTag = u16(p);
+        out.channels = u16(p + 2);
+        out.sampleRate = u32(p + 4);
+        out.blockAlign = u16(p + 12);
+        out.bitsPerSample = u16(p + 14);
+
+        out.extBytes = size - 16 < MAX_EXT ? size - 16 : MAX_EXT;
+        memcpy(out.ext, p + 16, out.extBytes);
+
+        // cbSize, valid bits, channel mask, then the GUID; its first two
+        // bytes are the format tag
+        if (out.formatTag == WAVE_FORMAT_EXTENSIBLE)
+        {
+            if (size < 40 || u16(p + 16) < 22)
+            {
+                return false;
+            }
+            out.formatTag = u16(p + 24);
+        }
+        return true;
+    }
+
+    static bool parseChunks(Shared<File> file, Info &out)
+    {
+        Window window{file};
+        uint32_t start = file->getOffset();
+        uint32_t fileEnd = file->size();
+
+        auto riff = window.at(start, 12);
+        if (riff == nullptr || !is(riff, "RIFF") || !is(riff + 8, "WAVE"))
+        {
+            return false;
+        }
+
+        bool haveFmt = false;
+        out.frames = 0;
+        uint32_t pos = start + 12;
+        while (pos + 8 <= fileEnd)
+        {
+            auto chunk = window.at(pos, 8);
+            if (chunk == nullptr)
+            {
+                return false;
+            }
+            uint32_t size = u32(chunk + 4);
+            uint32_t body = pos + 8;
+
+            if (is(chunk, "fmt "))
+            {
+                uint32_t n = size < 16 + MAX_EXT ? size : 16 + MAX_EXT;
+                auto p = window.at(body, n);
+                if (p == nullptr || !parseFmt(p, size, out))
+                {
+                    return false;
+                }
+                haveFmt = true;
+            }
+            else if (is(chunk, "fact") && size >= 4)
+            {
+                auto p = window.at(body, 4);
+                if (p != nullptr)
+                {
+                    out.frames = u32(p);
+                }
+            }
+            else if (is(chunk, "data"))
+            {
+                if (!haveFmt)
+                {
+                    return false;
+                }
+                // streamed files leave the size at 0 or -1, trust the file
+                uint32_t left = fileEnd - body;
+                out.dataOffset = body;
+                out.dataBytes = (size == 0 || size > left) ? left : size;
+                return true;
+            }
+
+            // chunks are padded to even sizes
+            uint32_t next = body + size + (size & 1);
+            if (next < body)
+            {
+                return false;
+            }
+            pos = next;
+        }
+        return false;
+    }
+
+    constexpr uint32_t CACHED = 8;
+
+    struct Cached
+    {
+        uint32_t number;
+        Info info;
+    };
+
+    static BlockingLock lock{};
+    static Cached cache[CACHED]{};
+    static uint32_t nextSlot = 0;
+
+    bool parse(Shared<File> file, Info &out)
+    {
+        // only whole files are cached, playing from the middle of one is odd
+        uint32_t number = file->getOffset() == 0 ? file->inumber() : 0;
+        if (number != 0)
+        {
+            LockGuard<BlockingLock> g{lock};
+            for (uint32_t i = 0; i < CACHED; i++)
+            {
+                if (cache[i].number == number)
+                {
+                    out = cache[i].info;
+                    return file->seek(out.dataOffset) == out.dataOffset;
+                }
+            }
+        }
+
+        if (!parseChunks(file, out))
+        {
+            return false;
+        }
+        if (file->seek(out.dataOffset) != out.dataOffset)
+        {
+            return false;
+        }
+
+        if (number != 0)
+        {
+            LockGuard<BlockingLock> g{lock};
+            cache[nextSlot].number = number;
+            cache[nextSlot].info = out;
+            nextSlot = (nextSlot + 1) % CACHED;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef _WAV_H_
+#define _WAV_H_
+
+#include "stdint.h"
+#include "shared.h"
+#include "file.h"
+
+// RIFF/WAVE header parsing
+//
+// Walks the chunk list of a WAV file in one pass over a buffer holding the
+// start of the file (it only reads again if a chunk it skips runs past the
+// buffer). Odd sized chunks are padded, LIST and anything else unknown is
+// skipped, a fact chunk is picked up, and WAVE_FORMAT_EXTENSIBLE is
+// resolved to the format in its SubFormat GUID.
+//
+// Results are cached by i-number (the file system is read-only), so
+// playing the same file again costs one seek.
+namespace WAV
+{
+    constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+    constexpr uint32_t MAX_EXT = 64;
+
+    struct Info
+    {
+        uint16_t formatTag;     // from SubFormat for extensible files
+        uint16_t channels;
+        uint32_t sampleRate;
+        uint16_t blockAlign;
+        uint16_t bitsPerSample; // container size, what blockAlign is made of
+        uint32_t extBytes;      // fmt chunk bytes past the first 16 (cbSize first), e.g. ADPCM parameters
+        uint8_t ext[MAX_EXT];
+        uint32_t frames;        // from the fact chunk, 0 if there is none
+        uint32_t dataOffset;
+        uint32_t dataBytes;     // clipped to what the file actually has
+    };
+
+    // Parses the header at the file's offset. On success the offset is
+    // left at the first byte of the data chunk.
+    extern bool parse(Shared<File> file, Info &out);
+}
+
+#endif
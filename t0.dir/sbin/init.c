@@ -7,6 +7,232 @@ void one(int fd)
     cp(fd, 2);
 }
 
+/* for tools/audiocheck.py (make t0.audio), not checked by t0.ok */
+void audio_report(void)
+{
+    static struct audio_trace_entry trace[128];
+    struct audio_position pos;
+
+    if (audio_position(-1, &pos) == 0) {
+        printf("audio: rate %lu\n", pos.rate);
+    }
+    int n = audio_trace(trace, 128);
+    for (int i = 0; i < n; i++) {
+        printf("audio: trace %lu %lu %u %u %lu\n", trace[i].tsc, trace[i].played,
+            trace[i].civ, trace[i].picb, trace[i].queued);
+    }
+}
+
+/* play_audio_async and the stream handle calls, checked by t0.ok */
+void test_async(void)
+{
+    printf("*** async bad fd = %d\n", play_audio_async(99));
+    printf("*** wait bad handle = %d\n", audio_wait(99));
+    printf("*** poll bad handle = %d\n", audio_poll(99));
+    printf("*** stop bad handle = %d\n", audio_stop(99));
+    int s = sem(0);
+    printf("*** poll semaphore = %d\n", audio_poll(s));
+    close(s);
+
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    printf("*** async ok = %d\n", h >= 0);
+    printf("*** poll playing = %d\n", audio_poll(h));
+    printf("*** stop = %d\n", audio_stop(h));
+    printf("*** poll stopped = %d\n", audio_poll(h));
+    printf("*** wait stopped = %d\n", audio_wait(h));
+    printf("*** close = %d\n", close(h));
+    printf("*** close again = %d\n", close(h));
+    printf("*** poll closed = %d\n", audio_poll(h));
+    close(fd);
+}
+
+/* audio_gain, checked by t0.ok */
+void test_gain(void)
+{
+    printf("*** gain bad handle = %d\n", audio_gain(99, 0x8000));
+
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    printf("*** gain half = %d\n", audio_gain(h, 0x4000));
+    printf("*** gain 0x10000 = %d\n", audio_gain(h, 0x10000));
+    audio_stop(h);
+    close(h);
+    close(fd);
+}
+
+/* /dev/audio, checked by t0.ok */
+void test_dev_audio(void)
+{
+    static char silence[4096];
+
+    int fd = open("/dev/audio", 0);
+    printf("*** /dev/audio open = %d\n", fd >= 0);
+    printf("*** /dev/audio write = %d\n", write(fd, silence, sizeof(silence)));
+    printf("*** async /dev/audio = %d\n", play_audio_async(fd));
+    close(fd);
+}
+
+/* audio_mmap and audio_mmap_wait, checked by t0.ok */
+void test_mmap(void)
+{
+    struct audio_ring *ring = 0;
+
+    int h = audio_mmap(&ring);
+    printf("*** mmap ok = %d\n", h >= 0);
+    if (h < 0) {
+        return;
+    }
+    printf("*** mmap ring = %lu %lu\n", ring->bytes, ring->rate);
+    printf("*** mmap twice = %d\n", audio_mmap(&ring));
+    printf("*** mmap wait = %d\n", audio_mmap_wait(h, 4096));
+    printf("*** mmap wait bad handle = %d\n", audio_mmap_wait(99, 4096));
+    printf("*** mmap close = %d\n", close(h));
+}
+
+/* /dev/audioin, checked by t0.ok */
+void test_audioin(void)
+{
+    int fd = open("/dev/audioin", 0);
+    printf("*** audioin open = %d\n", fd >= 0);
+    printf("*** audioin twice = %d\n", open("/dev/audioin", 0));
+    close(fd);
+    fd = open("/dev/audioin", 0);
+    printf("*** audioin reopen = %d\n", fd >= 0);
+    close(fd);
+}
+
+/* audio_period, checked by t0.ok */
+void test_period(void)
+{
+    printf("*** period 31 x 4 = %d\n", audio_period(31, 4));
+    printf("*** period 2049 x 4 = %d\n", audio_period(2049, 4));
+    printf("*** period 2048 x 1 = %d\n", audio_period(2048, 1));
+    printf("*** period 2048 x 257 = %d\n", audio_period(2048, 257));
+    printf("*** period 256 x 8 = %d\n", audio_period(256, 8));
+    printf("*** period 2048 x 32 = %d\n", audio_period(2048, 32));
+}
+
+/* audio_position, checked by t0.ok */
+void test_position(void)
+{
+    struct audio_position before, after;
+
+    printf("*** position bad handle = %d\n", audio_position(99, &before));
+    printf("*** position device = %d\n", audio_position(-1, &before));
+
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    printf("*** position = %d\n", audio_position(h, &before));
+    do {
+        audio_position(h, &after);
+    } while (after.frames <= before.frames && audio_poll(h) == 1);
+    printf("*** position moves = %d\n", after.frames > before.frames);
+    audio_stop(h);
+    close(h);
+    close(fd);
+}
+
+/* audio_cache_stats, checked by t0.ok */
+void test_cache(void)
+{
+    struct audio_cache_stats first, again;
+
+    int fd = open("/data/click.wav", 0);
+    play_audio(fd);
+    audio_cache_stats(&first);
+    seek(fd, 0);
+    play_audio(fd);
+    printf("*** cache stats = %d\n", audio_cache_stats(&again));
+    printf("*** cache hits on replay = %lu\n", again.hits - first.hits);
+    printf("*** cache clips = %lu\n", again.clips);
+    close(fd);
+}
+
+/* audio_enqueue, checked by t0.ok */
+void test_enqueue(void)
+{
+    int clip = open("/data/click.wav", 0);
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    printf("*** enqueue not a playlist = %d\n", audio_enqueue(h, clip));
+    audio_stop(h);
+    close(h);
+    close(fd);
+
+    seek(clip, 0);
+    fd = open("/data/stereo.wav", 0);
+    int list = audio_enqueue(-1, fd);
+    printf("*** playlist = %d\n", list >= 0);
+    printf("*** enqueue = %d\n", audio_enqueue(list, clip) == list);
+    printf("*** playlist playing = %d\n", audio_poll(list));
+    audio_stop(list);
+    printf("*** playlist stopped = %d\n", audio_wait(list));
+    close(list);
+    close(fd);
+    close(clip);
+}
+
+/* audio_dsp, checked by t0.ok */
+void test_dsp(void)
+{
+    struct audio_dsp dsp;
+
+    memset(&dsp, 0, sizeof(dsp));
+    dsp.ramp_frames = 4800;
+    dsp.limit = 0x7000;
+    dsp.release_frames = 4800;
+    printf("*** dsp bad handle = %d\n", audio_dsp(99, &dsp));
+
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    printf("*** dsp = %d\n", audio_dsp(h, &dsp));
+    printf("*** dsp gain = %d\n", audio_gain(h, 0x4000));
+    audio_stop(h);
+    close(h);
+    close(fd);
+}
+
+/* audio_stats and audio_trace, checked by t0.ok */
+void test_stats(void)
+{
+    static struct audio_stats stats;
+    static struct audio_trace_entry trace[16];
+
+    printf("*** stats bad handle = %d\n", audio_stats(99, &stats));
+    printf("*** stats device = %d\n", audio_stats(-1, &stats));
+    printf("*** stats periods = %d\n", stats.periods > 0);
+    printf("*** trace = %d\n", audio_trace(trace, 16) > 0);
+
+    int fd = open("/data/stereo.wav", 0);
+    int h = play_audio_async(fd);
+    do {
+        audio_stats(h, &stats);
+    } while (stats.frames == 0 && audio_poll(h) == 1);
+    printf("*** stats frames = %d\n", stats.frames > 0);
+    audio_stop(h);
+    close(h);
+    close(fd);
+}
+
+/* audio_play_at, checked by t0.ok */
+void test_play_at(void)
+{
+    struct audio_position now;
+
+    printf("*** play at bad fd = %d\n", audio_play_at(99, 0));
+
+    audio_position(-1, &now);
+    int fd = open("/data/stereo.wav", 0);
+    int h = audio_play_at(fd, now.frames + 48000);
+    printf("*** play at = %d\n", h >= 0);
+    printf("*** play at poll = %d\n", audio_poll(h));
+    audio_stop(h);
+    printf("*** play at stopped = %d\n", audio_wait(h));
+    close(h);
+    close(fd);
+}
+
 int main(int argc, char **argv)
 {
 
@@ -14,9 +240,22 @@ int main(int argc, char **argv)
     int fd = open("/data/stereo.wav", 0);
     play_audio(fd);
     close(fd);
+    audio_report();
     fd = open("/data/d4vdstereo.wav", 0);
     play_audio(fd);
     close(fd);
+    test_async();
+    test_gain();
+    test_dev_audio();
+    test_mmap();
+    test_audioin();
+    test_period();
+    test_position();
+    test_cache();
+    test_enqueue();
+    test_dsp();
+    test_stats();
+    test_play_at();
 
     printf("Exited sys call.\n");
     
@@ -18,6 +18,8 @@ extern void exit(int rc);
 
 /* open */
 /* opens a file, returns file descriptor, flags is ignored */
+/* "/dev/audio" is the audio output: write 16-bit stereo 48kHz PCM to it */
+/* "/dev/audioin" is the line in: read 16-bit stereo 48kHz PCM from it, one opener at a time */
 extern int open(const char* fn, int flags);
 
 /* len */
@@ -48,6 +50,7 @@ extern int down(int id);
 
 /* close */
 /* closes either a file or a semaphore or disowns a child process */
+/* or a stream handle; the stream stops once every handle to it is closed (or its process exits) */
 /* return 0 on success, -ve value on failure */
 extern int close(int id);
 
@@ -78,6 +81,164 @@ extern int fork();
 /* a nullptr indicates end of arguments */
 extern int execl(const char* path, const char* arg0, ...);
 
+/* play_audio */
+/* plays a WAV file to the end, returns 1 on success */
 extern void play_audio(int fd);
 
+/* play_audio_async */
+/* starts playing a WAV file in the background, returns a stream handle */
+extern int play_audio_async(int fd);
+
+/* audio_wait */
+/* waits for a stream to end, returns 0 if it played to the end, 1 if it was stopped */
+extern int audio_wait(int stream);
+
+/* audio_poll */
+/* returns 1 while the stream is playing, 0 once it is done */
+extern int audio_poll(int stream);
+
+/* audio_stop */
+/* stops a stream and waits for the sound card to let go of it */
+/* return 0 on success, -ve value on failure */
+extern int audio_stop(int stream);
+
+/* audio_gain */
+/* sets the mixing gain of a stream, Q15 fixed point (0x8000 is unity, max 0xFFFF) */
+/* return 0 on success, -ve value on failure */
+extern int audio_gain(int stream, uint32_t q15);
+
+/* a mapped audio ring, samples (16-bit stereo at 'rate') start one page after it */
+/* write samples at tail % bytes, then advance tail; the kernel advances head as it plays */
+struct audio_ring {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t bytes;
+    uint32_t rate;
+    volatile uint32_t underruns;
+};
+
+/* audio_mmap */
+/* maps a new audio ring into this process and starts playing it, *ring points to it */
+/* returns a stream handle, closing it unmaps the ring; one ring per process */
+extern int audio_mmap(struct audio_ring** ring);
+
+/* audio_mmap_wait */
+/* blocks until at least 'bytes' of the ring are free */
+/* return 0 on success, -ve value if the stream was stopped */
+extern int audio_mmap_wait(int stream, uint32_t bytes);
+
+/* audio_period */
+/* streams this process starts from now on queue at most 'count' periods of 'frames' each */
+/* (32..2048 frames, 2..256 periods; 2048 x 32 if no stream playing asked). Small values mean low */
+/* latency, the device uses the smallest settings of all the streams playing that asked and lowers */
+/* what it can't do (AC97: 32 periods; HDA: 256 periods of up to 2048 frames, rounded down to a */
+/* multiple of 32 frames, and settings stay put until the device goes idle) */
+/* return 0 on success, -ve value if out of range */
+extern int audio_period(uint32_t frames, uint32_t count);
+
+/* where playback is, read from the DMA engine together with two clocks */
+/* 'frames' are at 'rate' (0 while the device is idle and the count stands still) */
+struct audio_position {
+    uint64_t frames;
+    uint64_t tsc;
+    uint32_t jiffies;
+    uint32_t rate;
+};
+
+/* audio_position */
+/* stream < 0: frames the device has played since boot */
+/* otherwise: frames of that stream played so far */
+/* return 0 on success, -ve value on failure */
+extern int audio_position(int stream, struct audio_position* pos);
+
+/* files up to 64KB are decoded once by play_audio and kept (up to 1MB, least recently played go first) */
+struct audio_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t clips;
+    uint32_t bytes;
+};
+
+/* audio_cache_stats */
+/* how the sound cache is doing */
+/* return 0 on success, -ve value on failure */
+extern int audio_cache_stats(struct audio_cache_stats* stats);
+
+/* audio_enqueue */
+/* queues the audio file fd for gapless playback after what 'stream' is playing; */
+/* stream < 0 starts a new playlist with it. Up to 16 tracks can wait, the playlist */
+/* ends once it runs dry and can't be added to after that. audio_wait and friends work on it */
+/* returns the playlist's stream handle, -ve value on failure */
+extern int audio_enqueue(int stream, int fd);
+
+/* per-stream effects, all fixed point */
+/* y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2], coefficients Q14 (clamped to +-4.0) */
+struct audio_biquad {
+    int32_t b0, b1, b2, a1, a2;
+};
+
+struct audio_dsp {
+    uint32_t ramp_frames;           /* audio_gain changes fade over this many frames, at most 2^20 */
+    uint32_t biquads;               /* how many of 'filters' to run, up to 4 */
+    struct audio_biquad filters[4];
+    uint32_t limit;                 /* peak limiter threshold, 0 -> off (0x7FFF is full scale) */
+    uint32_t release_frames;        /* limiter recovery time */
+};
+
+/* audio_dsp */
+/* runs the stream through gain ramp, filters and limiter before it's mixed; replaces earlier settings */
+/* return 0 on success, -ve value on failure */
+extern int audio_dsp(int stream, const struct audio_dsp* dsp);
+
+/* audio instrumentation, times are in TSC cycles (audio_position pairs the TSC with jiffies) */
+/* histograms are powers of two: bucket 0 is < 2^11 cycles, bucket b is [2^(10+b), 2^(11+b)), */
+/* the last bucket also counts everything above */
+struct audio_histogram {
+    uint32_t count[16];
+    uint32_t max;
+};
+
+struct audio_stats {
+    /* the device, since boot */
+    uint32_t runs;              /* times DMA was started */
+    uint32_t periods;           /* refilled */
+    uint32_t last_valid_events; /* hardware ran dry (also happens at the end of every run) */
+    uint32_t fifo_errors;
+    struct audio_histogram refill; /* mixing one period */
+    struct audio_histogram wakeup; /* buffer completion to the mixer running */
+    /* the stream asked for, zeros without one */
+    uint64_t frames;            /* rendered, 4 bytes each */
+    uint32_t silent_frames;     /* filled in because a /dev/audio or mapped writer, or the disk, was late */
+    uint32_t stream_periods;
+    struct audio_histogram render; /* decode, convert, resample and effects for one period */
+};
+
+/* audio_stats */
+/* stream < 0 for device counters only */
+/* return 0 on success, -ve value on failure */
+extern int audio_stats(int stream, struct audio_stats* stats);
+
+/* taken at every refill: where the DMA engine was */
+struct audio_trace_entry {
+    uint32_t tsc;       /* low half */
+    uint32_t played;    /* periods completed this run */
+    uint16_t civ;       /* descriptor being played */
+    uint16_t picb;      /* samples left in it */
+    uint32_t queued;    /* periods in the ring, including that one */
+};
+
+/* audio_trace */
+/* copies up to max of the latest (up to 128) trace entries, oldest first */
+/* returns how many, -ve value on failure */
+extern int audio_trace(struct audio_trace_entry* entries, uint32_t max);
+
+/* audio_play_at */
+/* like play_audio_async, but the first sample plays at device frame 'frame' (audio_position(-1, ...)) */
+/* streams given the same frame start on the same sample. The device keeps up to a ring's worth */
+/* queued (audio_period), pick a frame at least that far ahead or it starts late, as soon as it can */
+/* (audio_position on the stream stays 0 until it starts). While the device is idle its clock */
+/* stands still and 'frame' counts from where it stopped */
+/* returns a stream handle, -ve value on failure */
+extern int audio_play_at(int fd, uint64_t frame);
+
 #endif
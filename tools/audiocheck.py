@@ -0,0 +1,247 @@
+import sys
+import wave
+import math
+import argparse
+from array import array
+
+# Compares what QEMU's wav audiodev recorded against the file the guest
+# played. With the device running at the source rate the kernel is expected
+# to be bit-exact (unity gain, no resampling), so every difference is a bug:
+#
+#   dropout           source frames that never came out
+#   inserted silence  zero frames that aren't in the source (late refills)
+#   inserted          other frames that aren't in the source
+#   corrupt           frames that are there but have the wrong value
+#
+# When the rates differ QEMU resamples and only timing is checked. The
+# serial log (--log) adds the kernel's refill trace (audio_trace).
+#
+#   python3 tools/audiocheck.py t0.dir/data/stereo.wav t0.wav --log t0.audio.raw
+
+WINDOW = 64        # frames that have to match to (re)synchronize
+MIN_GAP = 32       # shorter zero runs are taken to be part of the music
+BLOCK = 4096       # frames compared at once while things match
+RATE_TOLERANCE = 0.005 # for resampled captures, about 8.6 cents
+
+def load(path):
+    w = wave.open(path, "rb")
+    if w.getsampwidth() != 2 or w.getnchannels() not in (1, 2):
+        sys.exit(path + ": only 16-bit mono/stereo PCM is supported")
+    raw = w.readframes(w.getnframes())
+    rate = w.getframerate()
+    if w.getnchannels() == 1:
+        # the kernel plays mono on both channels
+        mono = array("H", raw)
+        stereo = array("H", bytes(len(mono) * 4))
+        stereo[0::2] = mono
+        stereo[1::2] = mono
+        raw = stereo.tobytes()
+    w.close()
+    # one 32-bit word per stereo frame, silence is 0
+    return rate, array("I", raw)
+
+def active(frames):
+    first = 0
+    while first < len(frames) and frames[first] == 0:
+        first += 1
+    last = len(frames)
+    while last > first and frames[last - 1] == 0:
+        last -= 1
+    return first, last
+
+def zero_run(frames, at, end):
+    n = at
+    while n < end and frames[n] == 0:
+        n += 1
+    return n - at
+
+def find(haystack, needle, start, end):
+    # frame aligned search, array has no find() but bytes does
+    hb = haystack[start:end].tobytes()
+    nb = needle.tobytes()
+    at = hb.find(nb)
+    while at >= 0 and at % 4 != 0:
+        at = hb.find(nb, at + 1)
+    return -1 if at < 0 else start + at // 4
+
+class Report:
+    def __init__(self):
+        self.matched = 0
+        self.dropouts = []    # (captured frame, source frames lost)
+        self.silence = []     # (captured frame, zero frames inserted)
+        self.inserted = []    # (captured frame, frames inserted)
+        self.corrupt = 0
+        self.missing = 0      # source frames after the capture ended
+
+    def exact(self):
+        return not (self.dropouts or self.silence or self.inserted or self.corrupt or self.missing)
+
+def compare(ref, cap, search):
+    r = Report()
+    i, iend = active(ref)
+    j, jend = active(cap)
+
+    while i < iend and j < jend:
+        n = min(BLOCK, iend - i, jend - j)
+        if ref[i:i + n] == cap[j:j + n]:
+            i += n
+            j += n
+            r.matched += n
+            continue
+        if ref[i] == cap[j]:
+            i += 1
+            j += 1
+            r.matched += 1
+            continue
+
+        # something's off at cap[j], see which side got ahead
+        k = min(WINDOW, iend - i, jend - j)
+        ahead = find(cap, ref[i:i + k], j + 1, min(jend, j + search))
+        behind = find(ref, cap[j:j + k], i + 1, min(iend, i + search))
+        if ahead >= 0 and (behind < 0 or ahead - j <= behind - i):
+            n = ahead - j
+            if zero_run(cap, j, ahead) == n:
+                r.silence.append((j, n))
+            else:
+                r.inserted.append((j, n))
+            j = ahead
+        elif behind >= 0:
+            r.dropouts.append((j, behind - i))
+            i = behind
+        else:
+            # wrong values; a silent stretch standing in for the music is a
+            # dropout the length of the stretch, anything else is corrupt
+            z = zero_run(cap, j, jend)
+            if z >= MIN_GAP:
+                r.dropouts.append((j, min(z, iend - i)))
+                i += z
+                j += z
+            else:
+                r.corrupt += 1
+                i += 1
+                j += 1
+
+    r.missing = max(0, iend - i)
+    return r
+
+def gaps(cap):
+    # zero runs inside the captured audio, for when there is no alignment
+    out = []
+    j, jend = active(cap)
+    while j < jend:
+        if cap[j] == 0:
+            n = zero_run(cap, j, jend)
+            if n >= MIN_GAP:
+                out.append((j, n))
+            j += n
+        else:
+            j += 1
+    return out
+
+def ms(frames, rate):
+    return "%.2fms" % (frames * 1000.0 / rate)
+
+def trace(log, period, rate):
+    # the device rate from the log wins over the source's
+    entries = []
+    for line in open(log, errors="replace"):
+        words = line.split()
+        if len(words) >= 2 and words[0] == "audio:":
+            if words[1] == "rate" and len(words) == 3 and int(words[2]) != 0:
+                rate = int(words[2])
+            elif words[1] == "trace" and len(words) == 7:
+                entries.append([int(x) for x in words[2:]])
+    if len(entries) < 2:
+        print("refills: no trace in " + log)
+        return
+
+    # frames played this run when the mixer woke up
+    def played(e):
+        tsc, periods, civ, picb, queued = e
+        return periods * period + period - picb // 2
+
+    cycles = 0
+    steps = []
+    for a, b in zip(entries, entries[1:]):
+        d = played(b) - played(a)
+        if d <= 0:
+            continue # a new run started
+        steps.append(d)
+        cycles += (b[0] - a[0]) & 0xFFFFFFFF
+
+    queued = [e[4] for e in entries]
+    print("refills: %d traced, %d periods of %d frames queued at most, %d at least" %
+          (len(entries), max(queued), period, min(queued)))
+    if not steps:
+        return
+    steps.sort()
+    line = "refill gap (frames): min %d median %d max %d" % (steps[0], steps[len(steps) // 2], steps[-1])
+    if rate:
+        line += " = %s / %s / %s at %dHz" % (ms(steps[0], rate), ms(steps[len(steps) // 2], rate), ms(steps[-1], rate), rate)
+    print(line)
+    print("refill gap (cycles): %d per frame on average" % (cycles // sum(steps)))
+
+def main():
+    parser = argparse.ArgumentParser(description="compare captured audio with its source")
+    parser.add_argument("source")
+    parser.add_argument("captured")
+    parser.add_argument("--log", help="serial output with the audio: lines from init")
+    parser.add_argument("--period", type=int, default=2048, help="period frames the guest used")
+    parser.add_argument("--search", type=float, default=2.0, help="seconds to look for a resync")
+    parser.add_argument("--verbose", action="store_true", help="list every glitch")
+    args = parser.parse_args()
+
+    ref_rate, ref = load(args.source)
+    cap_rate, cap = load(args.captured)
+    rfirst, rlast = active(ref)
+    cfirst, clast = active(cap)
+
+    print("source  : %s %d frames at %dHz" % (args.source, rlast - rfirst, ref_rate))
+    print("captured: %s %d frames at %dHz, starts after %s" %
+          (args.captured, clast - cfirst, cap_rate, ms(cfirst, cap_rate)))
+
+    ok = True
+    if clast == cfirst:
+        print("FAIL: nothing was captured")
+        ok = False
+    elif ref_rate == cap_rate:
+        r = compare(ref, cap, int(args.search * ref_rate))
+        lost = sum(n for at, n in r.dropouts)
+        quiet = sum(n for at, n in r.silence)
+        extra = sum(n for at, n in r.inserted)
+        print("matched : %d frames (%.3f%%)" % (r.matched, 100.0 * r.matched / max(1, rlast - rfirst)))
+        print("dropouts: %d, %d frames (%s)" % (len(r.dropouts), lost, ms(lost, ref_rate)))
+        print("inserted silence: %d, %d frames (%s)" % (len(r.silence), quiet, ms(quiet, ref_rate)))
+        print("inserted other  : %d, %d frames" % (len(r.inserted), extra))
+        print("corrupt : %d frames" % r.corrupt)
+        print("missing : %d frames at the end" % r.missing)
+        if args.verbose:
+            for what, events in (("dropout", r.dropouts), ("silence", r.silence), ("inserted", r.inserted)):
+                for at, n in events:
+                    print("  %-8s at %s: %d frames" % (what, ms(at - cfirst, cap_rate), n))
+
+        # whatever was played should take as long as it does in the source
+        expect = (rlast - rfirst) - lost - r.missing + quiet + extra
+        ratio = (clast - cfirst) / float(max(1, expect))
+        print("rate    : %+.1f ppm (%+.2f cents)" % ((ratio - 1) * 1e6, 1200 * math.log(ratio, 2)))
+        ok = r.exact() and ratio == 1.0
+    else:
+        # QEMU resampled, only the timing means something
+        print("rates differ, not comparing samples")
+        ratio = ((clast - cfirst) / float(cap_rate)) / ((rlast - rfirst) / float(ref_rate))
+        print("rate    : %+.1f ppm (%+.2f cents) by duration" % ((ratio - 1) * 1e6, 1200 * math.log(ratio, 2)))
+        g = gaps(cap)
+        expect = gaps(ref)
+        print("silent gaps: %d, %d frames (%d in the source)" % (len(g), sum(n for at, n in g), len(expect)))
+        if args.verbose:
+            for at, n in g:
+                print("  gap at %s: %s" % (ms(at - cfirst, cap_rate), ms(n, cap_rate)))
+        ok = len(g) <= len(expect) and abs(ratio - 1) < RATE_TOLERANCE
+
+    if args.log:
+        trace(args.log, args.period, ref_rate)
+
+    print("PASS" if ok else "FAIL")
+    sys.exit(0 if ok else 1)
+
+main()